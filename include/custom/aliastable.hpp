@@ -0,0 +1,209 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef ALIASTABLE_HPP
+#define ALIASTABLE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Discrete distribution sampled in constant time (Vose's alias method).
+   Every bucket holds the probability of keeping its own index and the
+   index it gives the rest of its mass to, a sample is one bucket lookup
+   and one comparison. Building is linear in the number of weights.
+ */
+class AliasTable {
+public:
+  AliasTable() {}
+
+  // weights need not be normalized, false when they are all zero
+  bool build(const float *weights, std::size_t count);
+
+  std::size_t getCount() const { return this->buckets.size(); }
+  // sum of the weights given to build
+  double getTotal() const { return this->total; }
+  // probability of sampling index
+  float getPdf(std::size_t index) const { return this->buckets[index].pdf; }
+
+  /* Index for u in [0, 1). The part of u not used to pick the index is
+     returned in remapped, uniform in [0, 1) again, so one random number
+     can also place a sample inside the picked bucket.
+   */
+  uint32_t sample(float u, float *remapped = nullptr) const;
+
+private:
+  struct Bucket {
+    float keep;
+    uint32_t alias;
+    float pdf;
+  };
+  std::vector<Bucket> buckets;
+  double total = 0.0;
+};
+
+inline bool AliasTable::build(const float *weights, std::size_t count) {
+  this->buckets.assign(count, Bucket{1.0f, 0, 0.0f});
+  this->total = 0.0;
+  for (std::size_t i = 0; i < count; i++) {
+    this->total += weights[i] > 0.0f ? weights[i] : 0.0f;
+  }
+  if (count == 0) {
+    return false;
+  }
+  if (this->total <= 0.0) {
+    // nothing to prefer, fall back to uniform so sampling stays valid
+    for (std::size_t i = 0; i < count; i++) {
+      this->buckets[i] = Bucket{1.0f, static_cast<uint32_t>(i),
+                                1.0f / static_cast<float>(count)};
+    }
+    return false;
+  }
+
+  // scaled weights are 1 on average, small ones borrow from large ones
+  std::vector<double> scaled(count);
+  std::vector<uint32_t> small, large;
+  small.reserve(count);
+  large.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    double w = weights[i] > 0.0f ? weights[i] : 0.0;
+    this->buckets[i].pdf = static_cast<float>(w / this->total);
+    scaled[i] = w * static_cast<double>(count) / this->total;
+    (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t s = small.back();
+    small.pop_back();
+    uint32_t l = large.back();
+    this->buckets[s].keep = static_cast<float>(scaled[s]);
+    this->buckets[s].alias = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // what is left is 1 up to rounding
+  for (uint32_t i : small) {
+    this->buckets[i].keep = 1.0f;
+    this->buckets[i].alias = i;
+  }
+  for (uint32_t i : large) {
+    this->buckets[i].keep = 1.0f;
+    this->buckets[i].alias = i;
+  }
+  return true;
+}
+
+inline uint32_t AliasTable::sample(float u, float *remapped) const {
+  float scaled = u * static_cast<float>(this->buckets.size());
+  std::size_t index = std::min(static_cast<std::size_t>(scaled),
+                               this->buckets.size() - 1);
+  float coin = scaled - static_cast<float>(index);
+  const Bucket &b = this->buckets[index];
+  // the coin is random, selects instead of a branch avoid mispredictions
+  bool keep = coin < b.keep;
+  if (remapped) {
+    float low = keep ? 0.0f : b.keep;
+    float width = keep ? b.keep : 1.0f - b.keep;
+    *remapped = std::min((coin - low) / width, 0.99999994f);
+  }
+  return keep ? static_cast<uint32_t>(index) : b.alias;
+}
+
+/* Alias table whose weights can change one at a time.
+   The weights are cut into blocks of about sqrt(n), each with its own
+   alias table, and a top table picks a block by its total. A sample is
+   two constant time lookups. setWeight only marks the block, refresh
+   rebuilds the marked blocks and the top table, which costs O(sqrt(n))
+   for one change instead of O(n). Do not refresh while other threads
+   sample.
+ */
+class BlockedAliasTable {
+public:
+  BlockedAliasTable() {}
+
+  void build(const float *weights, std::size_t count);
+  void setWeight(std::size_t index, float weight);
+  void refresh();
+
+  std::size_t getCount() const { return this->weights.size(); }
+  std::size_t getBlockSize() const { return this->blockSize; }
+  float getPdf(std::size_t index) const;
+  uint32_t sample(float u, float *pdf = nullptr) const;
+
+private:
+  std::size_t blockSize = 1;
+  std::vector<float> weights;
+  std::vector<AliasTable> blocks;
+  AliasTable top;
+  std::vector<float> blockWeights;
+  std::vector<uint32_t> dirty;
+  std::vector<bool> isDirty;
+
+  void buildBlock(std::size_t b);
+};
+
+inline void BlockedAliasTable::build(const float *weights, std::size_t count) {
+  this->weights.assign(weights, weights + count);
+  this->blockSize = std::max<std::size_t>(
+      16, static_cast<std::size_t>(std::ceil(std::sqrt(double(count)))));
+  std::size_t blockCount = (count + this->blockSize - 1) / this->blockSize;
+  this->blocks.assign(blockCount, AliasTable());
+  this->blockWeights.assign(blockCount, 0.0f);
+  this->isDirty.assign(blockCount, false);
+  this->dirty.clear();
+  for (std::size_t b = 0; b < blockCount; b++) {
+    this->buildBlock(b);
+  }
+  this->top.build(this->blockWeights.data(), blockCount);
+}
+
+inline void BlockedAliasTable::buildBlock(std::size_t b) {
+  std::size_t first = b * this->blockSize;
+  std::size_t count = std::min(this->blockSize, this->weights.size() - first);
+  this->blocks[b].build(&this->weights[first], count);
+  this->blockWeights[b] = static_cast<float>(this->blocks[b].getTotal());
+}
+
+inline void BlockedAliasTable::setWeight(std::size_t index, float weight) {
+  this->weights[index] = weight;
+  std::size_t b = index / this->blockSize;
+  if (!this->isDirty[b]) {
+    this->isDirty[b] = true;
+    this->dirty.push_back(static_cast<uint32_t>(b));
+  }
+}
+
+inline void BlockedAliasTable::refresh() {
+  if (this->dirty.empty()) {
+    return;
+  }
+  for (uint32_t b : this->dirty) {
+    this->buildBlock(b);
+    this->isDirty[b] = false;
+  }
+  this->dirty.clear();
+  this->top.build(this->blockWeights.data(), this->blockWeights.size());
+}
+
+inline float BlockedAliasTable::getPdf(std::size_t index) const {
+  std::size_t b = index / this->blockSize;
+  return this->top.getPdf(b) *
+         this->blocks[b].getPdf(index - b * this->blockSize);
+}
+
+inline uint32_t BlockedAliasTable::sample(float u, float *pdf) const {
+  float rest;
+  uint32_t b = this->top.sample(u, &rest);
+  uint32_t i = this->blocks[b].sample(rest);
+  if (pdf) {
+    *pdf = this->top.getPdf(b) * this->blocks[b].getPdf(i);
+  }
+  return static_cast<uint32_t>(b * this->blockSize + i);
+}
+
+#endif
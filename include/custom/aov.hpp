@@ -0,0 +1,127 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef AOV_HPP
+#define AOV_HPP
+
+#include <custom/denoiser.hpp>
+#include <custom/framebuffer.hpp>
+
+#include <cmath>
+#include <vector>
+
+// arbitrary output variables that can be stored next to the color
+enum AovFlag : unsigned int {
+  AOV_NONE = 0,
+  AOV_DEPTH = 1 << 0,
+  AOV_NORMAL = 1 << 1,
+  AOV_ALBEDO = 1 << 2,
+  AOV_INSTANCE_ID = 1 << 3,
+  AOV_ALL = AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO | AOV_INSTANCE_ID
+};
+
+constexpr bool aovEnabled(unsigned int mask, unsigned int flag) {
+  return (mask & flag) != 0;
+}
+
+// everything a single camera sample can report
+template <typename T> struct AovSampleT {
+  Vec3T<T> color = Vec3T<T>(T(0));
+  // distance to the first hit, infinity for the background
+  T depth = T(INFINITY);
+  Vec3T<T> normal = Vec3T<T>(T(0));
+  Vec3T<T> albedo = Vec3T<T>(T(0));
+  // -1 when the sample did not hit anything
+  int instanceId = -1;
+};
+using AovSample = AovSampleT<float>;
+
+// storage of a single aov, only allocated when the aov is enabled
+template <typename T, bool Enabled> class AovBuffer {
+public:
+  static constexpr bool enabled = true;
+  std::vector<T> data;
+
+  void allocate(std::size_t size, T clearValue) {
+    this->data.assign(size, clearValue);
+  }
+  void write(std::size_t index, const T &value) { this->data[index] = value; }
+  // running mean, n is the sample count including this sample
+  void accumulate(std::size_t index, const T &value, unsigned int n) {
+    this->data[index] += (value - this->data[index]) / static_cast<float>(n);
+  }
+  const T *get() const { return this->data.data(); }
+};
+
+// disabled aovs have no storage and every write compiles to nothing
+template <typename T> class AovBuffer<T, false> {
+public:
+  static constexpr bool enabled = false;
+
+  void allocate(std::size_t, T) {}
+  void write(std::size_t, const T &) {}
+  void accumulate(std::size_t, const T &, unsigned int) {}
+  const T *get() const { return nullptr; }
+};
+
+// aovs are stored in float whatever the precision of the color is, they
+// only feed the denoiser and compositing
+template <unsigned int Mask, typename T = float>
+class AovFramebuffer : public FramebufferT<T> {
+public:
+  AovBuffer<float, aovEnabled(Mask, AOV_DEPTH)> depth;
+  AovBuffer<glm::vec3, aovEnabled(Mask, AOV_NORMAL)> normal;
+  AovBuffer<glm::vec3, aovEnabled(Mask, AOV_ALBEDO)> albedo;
+  AovBuffer<int, aovEnabled(Mask, AOV_INSTANCE_ID)> instanceId;
+
+  AovFramebuffer(int w, int h);
+
+  using FramebufferT<T>::addSample;
+  void addSample(int x, int y, const AovSampleT<T> &sample);
+  // denoiser guides for the aovs that are enabled
+  DenoiseGuides getGuides() const;
+};
+
+template <unsigned int Mask, typename T>
+AovFramebuffer<Mask, T>::AovFramebuffer(int w, int h)
+    : FramebufferT<T>(w, h) {
+  std::size_t n = this->pixels.size();
+  this->depth.allocate(n, 0.0f);
+  this->normal.allocate(n, glm::vec3(0.0f));
+  this->albedo.allocate(n, glm::vec3(0.0f));
+  this->instanceId.allocate(n, -1);
+}
+
+template <unsigned int Mask, typename T>
+void AovFramebuffer<Mask, T>::addSample(int x, int y,
+                                        const AovSampleT<T> &sample) {
+  /* Geometric aovs are averaged over the pixel samples like the color,
+     which keeps silhouettes anti aliased in the guides. The instance id
+     can not be averaged, the first sample of the pixel decides it.
+   */
+  FramebufferT<T>::addSample(x, y, sample.color);
+  std::size_t index = y * this->width + x;
+  unsigned int n = this->pixels[index].sampleCount;
+  if constexpr (aovEnabled(Mask, AOV_DEPTH)) {
+    // the background has no finite depth, it is stored as 0
+    float d = std::isfinite(sample.depth) ? float(sample.depth) : 0.0f;
+    this->depth.accumulate(index, d, n);
+  }
+  this->normal.accumulate(index, glm::vec3(sample.normal), n);
+  this->albedo.accumulate(index, glm::vec3(sample.albedo), n);
+  if (n == 1) {
+    this->instanceId.write(index, sample.instanceId);
+  }
+}
+
+template <unsigned int Mask, typename T>
+DenoiseGuides AovFramebuffer<Mask, T>::getGuides() const {
+  DenoiseGuides guides;
+  guides.depth = this->depth.get();
+  guides.normal = this->normal.get();
+  guides.albedo = this->albedo.get();
+  return guides;
+}
+
+#endif
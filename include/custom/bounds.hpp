@@ -0,0 +1,53 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+
+#include <custom/ray.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// axis aligned box, empty until a point is added
+struct Bounds {
+  glm::vec3 lo = glm::vec3(INFINITY);
+  glm::vec3 hi = glm::vec3(-INFINITY);
+
+  void grow(glm::vec3 p) {
+    this->lo = glm::min(this->lo, p);
+    this->hi = glm::max(this->hi, p);
+  }
+  void grow(const Bounds &b) {
+    this->lo = glm::min(this->lo, b.lo);
+    this->hi = glm::max(this->hi, b.hi);
+  }
+  glm::vec3 getCenter() const { return 0.5f * (this->lo + this->hi); }
+  glm::vec3 getExtent() const { return this->hi - this->lo; }
+  // slab test, invDirection is 1 / ray direction
+  bool hit(const Ray &ray, glm::vec3 invDirection, float tmin,
+           float tmax) const;
+  // same, entry is where the ray enters the box, clamped to tmin
+  bool hit(const Ray &ray, glm::vec3 invDirection, float tmin, float tmax,
+           float &entry) const;
+};
+
+inline bool Bounds::hit(const Ray &ray, glm::vec3 invDirection, float tmin,
+                        float tmax) const {
+  float entry;
+  return this->hit(ray, invDirection, tmin, tmax, entry);
+}
+
+inline bool Bounds::hit(const Ray &ray, glm::vec3 invDirection, float tmin,
+                        float tmax, float &entry) const {
+  glm::vec3 t0 = (this->lo - ray.origin) * invDirection;
+  glm::vec3 t1 = (this->hi - ray.origin) * invDirection;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar = glm::max(t0, t1);
+  entry = std::max(tmin, std::max(tNear.x, std::max(tNear.y, tNear.z)));
+  tmax = std::min(tmax, std::min(tFar.x, std::min(tFar.y, tFar.z)));
+  return entry <= tmax;
+}
+
+#endif
@@ -5,21 +5,14 @@
 #ifndef CAMERA_HPP
 #define CAMERA_HPP
 
-#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-enum Camera_Movement { FORWARD, BACKWARD, LEFT, RIGHT };
+#include <custom/ray.hpp>
 
-struct Ray {
-  glm::vec3 origin;
-  glm::vec3 direction;
-};
-struct Segment {
-  glm::vec3 origin;
-  glm::vec3 direction;
-  float size;
-};
+#include <cmath>
+
+enum Camera_Movement { FORWARD, BACKWARD, LEFT, RIGHT };
 
 // default values for the camera
 const float YAW = -90.0f;
@@ -28,54 +21,61 @@ const float SPEED = 2.5f;
 const float SENSITIVITY = 0.00001f;
 const float ZOOM = 45.0f;
 
-// Abstract camera class
-class Camera {
+// Abstract camera class, templated on its scalar so the ray tracer can run
+// it in float or double
+template <typename T> class CameraT {
 public:
-  glm::vec3 pos;
-  glm::vec3 front;
-  glm::vec3 up;
-  glm::vec3 right;
-  glm::vec3 worldUp;
+  Vec3T<T> pos;
+  Vec3T<T> front;
+  Vec3T<T> up;
+  Vec3T<T> right;
+  Vec3T<T> worldUp;
   // euler angles
-  float yaw;
-  float pitch;
+  T yaw;
+  T pitch;
 
   // camera options
-  float movementSpeed;
-  float mouseSensitivity;
-  float zoom;
+  T movementSpeed;
+  T mouseSensitivity;
+  T zoom;
 
   // Constructor 1
-  Camera(glm::vec3 Position = glm::vec3(0.0f, 0.0f, 0.0f),
-         glm::vec3 Up = glm::vec3(0.0f, 1.0f, 0.0f), float Yaw = YAW,
-         float Pitch = PITCH, float Zoom = ZOOM,
-         glm::vec3 Front = glm::vec3(0.0f, 0.0f, -1.0f), float Speed = SPEED,
-         float Sens = SENSITIVITY);
+  CameraT(Vec3T<T> Position = Vec3T<T>(0.0f, 0.0f, 0.0f),
+          Vec3T<T> Up = Vec3T<T>(0.0f, 1.0f, 0.0f), T Yaw = YAW,
+          T Pitch = PITCH, T Zoom = ZOOM,
+          Vec3T<T> Front = Vec3T<T>(0.0f, 0.0f, -1.0f), T Speed = SPEED,
+          T Sens = SENSITIVITY);
 
   // Constructor 2
-  Camera(float posX, float posY, float posZ, float upX, float upY, float upZ,
-         float Yaw, float Pitch, glm::vec3 Front = glm::vec3(0.0f, 0.0f, -1.0f),
-         float Speed = SPEED, float Sens = SENSITIVITY, float Zoom = ZOOM);
-  void processKeyBoardRotate(Camera_Movement direction, float deltaTime);
-  virtual void processKeyboard(Camera_Movement direction, float deltaTime);
-  glm::mat4 getViewMatrix();
-  virtual void processMouseMovement(float xoffset, float yoffset,
-                                    GLboolean pitchBound = true);
-  void processMouseScroll(float yoffset);
-  Ray getRayToPosV4Perspective(glm::vec4 posn);
-  Ray getRayToPosV4Ortho(glm::vec4 posn);
-  Segment getSegmentToPosV4Perspective(glm::vec4 posn);
-  Segment getSegmentToPosV4Ortho(glm::vec4 posn);
-  glm::vec3 getPosToPosV4Perspective(glm::vec4 posn);
-  glm::vec3 getPosToPosV4Ortho(glm::vec4 posn);
+  CameraT(T posX, T posY, T posZ, T upX, T upY, T upZ, T Yaw, T Pitch,
+          Vec3T<T> Front = Vec3T<T>(0.0f, 0.0f, -1.0f), T Speed = SPEED,
+          T Sens = SENSITIVITY, T Zoom = ZOOM);
+  virtual ~CameraT() {}
+  void processKeyBoardRotate(Camera_Movement direction, T deltaTime);
+  virtual void processKeyboard(Camera_Movement direction, T deltaTime);
+  glm::mat<4, 4, T> getViewMatrix();
+  virtual void processMouseMovement(T xoffset, T yoffset,
+                                    bool pitchBound = true);
+  void processMouseScroll(T yoffset);
+  RayT<T> getRay(T s, T t, T aspect) const;
+  // ds and dt are the width and height of a pixel on the image plane
+  RayDifferentialT<T> getRayDifferential(T s, T t, T aspect, T ds,
+                                         T dt) const;
+  RayT<T> getRayToPosV4Perspective(glm::vec<4, T> posn);
+  RayT<T> getRayToPosV4Ortho(glm::vec<4, T> posn);
+  SegmentT<T> getSegmentToPosV4Perspective(glm::vec<4, T> posn);
+  SegmentT<T> getSegmentToPosV4Ortho(glm::vec<4, T> posn);
+  Vec3T<T> getPosToPosV4Perspective(glm::vec<4, T> posn);
+  Vec3T<T> getPosToPosV4Ortho(glm::vec<4, T> posn);
 
 private:
   void updateCameraVectors();
 };
 
 // first constructor
-Camera::Camera(glm::vec3 Position, glm::vec3 Up, float Yaw, float Pitch,
-               float Zoom, glm::vec3 Front, float Speed, float Sens) {
+template <typename T>
+CameraT<T>::CameraT(Vec3T<T> Position, Vec3T<T> Up, T Yaw, T Pitch, T Zoom,
+                    Vec3T<T> Front, T Speed, T Sens) {
   this->pos = Position;
   this->worldUp = Up;
   this->pitch = Pitch;
@@ -88,11 +88,11 @@ Camera::Camera(glm::vec3 Position, glm::vec3 Up, float Yaw, float Pitch,
 }
 
 // second constructor
-Camera::Camera(float posX, float posY, float posZ, float upX, float upY,
-               float upZ, float Yaw, float Pitch, glm::vec3 Front, float Speed,
-               float Sens, float Zoom) {
-  this->pos = glm::vec3(posX, posY, posZ);
-  this->worldUp = glm::vec3(upX, upY, upZ);
+template <typename T>
+CameraT<T>::CameraT(T posX, T posY, T posZ, T upX, T upY, T upZ, T Yaw,
+                    T Pitch, Vec3T<T> Front, T Speed, T Sens, T Zoom) {
+  this->pos = Vec3T<T>(posX, posY, posZ);
+  this->worldUp = Vec3T<T>(upX, upY, upZ);
   this->yaw = Yaw;
   this->pitch = Pitch;
   this->movementSpeed = Speed;
@@ -101,8 +101,8 @@ Camera::Camera(float posX, float posY, float posZ, float upX, float upY,
   this->front = Front;
   this->updateCameraVectors();
 }
-void Camera::updateCameraVectors() {
-  glm::vec3 front;
+template <typename T> void CameraT<T>::updateCameraVectors() {
+  Vec3T<T> front;
   // compute new front
   front.x = cos(glm::radians(this->yaw)) * cos(glm::radians(this->pitch));
   front.y = sin(glm::radians(this->pitch));
@@ -113,8 +113,9 @@ void Camera::updateCameraVectors() {
   this->right = glm::normalize(glm::cross(this->front, this->worldUp));
   this->up = glm::normalize(glm::cross(this->right, this->front));
 }
-void Camera::processKeyboard(Camera_Movement direction, float deltaTime) {
-  float velocity = this->movementSpeed * deltaTime;
+template <typename T>
+void CameraT<T>::processKeyboard(Camera_Movement direction, T deltaTime) {
+  T velocity = this->movementSpeed * deltaTime;
   switch (direction) {
   case FORWARD:
     this->pos += this->front * velocity;
@@ -131,20 +132,20 @@ void Camera::processKeyboard(Camera_Movement direction, float deltaTime) {
   }
 }
 
-glm::mat4 Camera::getViewMatrix() {
-  glm::vec3 target = this->pos + this->front;
-  glm::vec3 upvec = this->up;
-  glm::vec3 cameraDirection = glm::normalize(this->pos - target);
-  glm::vec3 right = glm::normalize(glm::cross(upvec, cameraDirection));
-  glm::vec3 realUp = glm::normalize(glm::cross(cameraDirection, right));
+template <typename T> glm::mat<4, 4, T> CameraT<T>::getViewMatrix() {
+  Vec3T<T> target = this->pos + this->front;
+  Vec3T<T> upvec = this->up;
+  Vec3T<T> cameraDirection = glm::normalize(this->pos - target);
+  Vec3T<T> right = glm::normalize(glm::cross(upvec, cameraDirection));
+  Vec3T<T> realUp = glm::normalize(glm::cross(cameraDirection, right));
   //
-  glm::mat4 trans(1.0f);
+  glm::mat<4, 4, T> trans(T(1));
   trans[3][0] = -this->pos.x;
   trans[3][1] = -this->pos.y;
   trans[3][2] = -this->pos.z;
 
   //
-  glm::mat4 rotation(1.0f);
+  glm::mat<4, 4, T> rotation(T(1));
   rotation[0][0] = right.x;
   rotation[1][0] = right.y;
   rotation[2][0] = right.z;
@@ -157,8 +158,8 @@ glm::mat4 Camera::getViewMatrix() {
   return rotation * trans;
 }
 
-void Camera::processMouseMovement(float xoffset, float yoffset,
-                                  GLboolean pitchBound) {
+template <typename T>
+void CameraT<T>::processMouseMovement(T xoffset, T yoffset, bool pitchBound) {
   xoffset *= this->mouseSensitivity;
   yoffset *= this->mouseSensitivity;
 
@@ -176,7 +177,9 @@ void Camera::processMouseMovement(float xoffset, float yoffset,
 
   this->updateCameraVectors();
 }
-void Camera::processKeyBoardRotate(Camera_Movement direction, float deltaTime) {
+template <typename T>
+void CameraT<T>::processKeyBoardRotate(Camera_Movement direction,
+                                       T deltaTime) {
 
   deltaTime *= this->movementSpeed;
   switch (direction) {
@@ -196,8 +199,8 @@ void Camera::processKeyBoardRotate(Camera_Movement direction, float deltaTime) {
   this->updateCameraVectors();
 }
 
-void Camera::processMouseScroll(float yoffset) {
-  float zoom = this->zoom;
+template <typename T> void CameraT<T>::processMouseScroll(T yoffset) {
+  T zoom = this->zoom;
 
   if (this->zoom >= 1.0f && this->zoom <= 45.0f) {
     this->zoom -= yoffset;
@@ -209,58 +212,98 @@ void Camera::processMouseScroll(float yoffset) {
     this->zoom = 45.0f;
   }
 }
-glm::vec3 Camera::getPosToPosV4Perspective(glm::vec4 pos) {
-  glm::vec3 posPers = glm::vec3(pos.x / pos.w, pos.y / pos.w, pos.z / pos.w);
+template <typename T>
+Vec3T<T> CameraT<T>::getPosToPosV4Perspective(glm::vec<4, T> pos) {
+  Vec3T<T> posPers = Vec3T<T>(pos.x / pos.w, pos.y / pos.w, pos.z / pos.w);
   return posPers - this->pos;
 }
-glm::vec3 Camera::getPosToPosV4Ortho(glm::vec4 pos) {
-  glm::vec3 posPers = glm::vec3(pos.x, pos.y, pos.z);
+template <typename T>
+Vec3T<T> CameraT<T>::getPosToPosV4Ortho(glm::vec<4, T> pos) {
+  Vec3T<T> posPers = Vec3T<T>(pos.x, pos.y, pos.z);
   return posPers - this->pos;
 }
-Segment Camera::getSegmentToPosV4Perspective(glm::vec4 pos) {
+template <typename T>
+SegmentT<T> CameraT<T>::getSegmentToPosV4Perspective(glm::vec<4, T> pos) {
   // do perspective division to starting point
   // then subtract from the start to have an end
-  glm::vec3 segment = this->getPosToPosV4Perspective(pos);
-  Segment s;
+  Vec3T<T> segment = this->getPosToPosV4Perspective(pos);
+  SegmentT<T> s;
   s.origin = segment;
   s.size = glm::length(segment);
   s.direction = glm::normalize(segment);
   return s;
 }
-Segment Camera::getSegmentToPosV4Ortho(glm::vec4 pos) {
+template <typename T>
+SegmentT<T> CameraT<T>::getSegmentToPosV4Ortho(glm::vec<4, T> pos) {
   // do perspective division to starting point
   // then subtract from the start to have an end
-  glm::vec3 segment = this->getPosToPosV4Ortho(pos);
-  Segment s;
+  Vec3T<T> segment = this->getPosToPosV4Ortho(pos);
+  SegmentT<T> s;
   s.origin = segment;
   s.direction = glm::normalize(segment);
   s.size = glm::length(segment);
   return s;
 }
-Ray Camera::getRayToPosV4Perspective(glm::vec4 pos) {
+template <typename T>
+RayT<T> CameraT<T>::getRayToPosV4Perspective(glm::vec<4, T> pos) {
   // do perspective division to starting point
   // then subtract from the start to have an end
-  Segment s = this->getSegmentToPosV4Perspective(pos);
-  Ray r;
+  SegmentT<T> s = this->getSegmentToPosV4Perspective(pos);
+  RayT<T> r;
   r.origin = s.origin;
   r.direction = s.direction;
   return r;
 }
-Ray Camera::getRayToPosV4Ortho(glm::vec4 pos) {
+template <typename T>
+RayT<T> CameraT<T>::getRayToPosV4Ortho(glm::vec<4, T> pos) {
   // do perspective division to starting point
   // then subtract from the start to have an end
-  Segment s = this->getSegmentToPosV4Ortho(pos);
-  Ray r;
+  SegmentT<T> s = this->getSegmentToPosV4Ortho(pos);
+  RayT<T> r;
   r.origin = s.origin;
   r.direction = s.direction;
   return r;
 }
 
+template <typename T>
+RayT<T> CameraT<T>::getRay(T s, T t, T aspect) const {
+  // primary ray through (s, t) in [0, 1]^2 of the image plane, zoom is the
+  // vertical field of view in degrees
+  T halfHeight = std::tan(glm::radians(this->zoom) / T(2));
+  T halfWidth = aspect * halfHeight;
+  Vec3T<T> dir = this->front + (T(2) * s - T(1)) * halfWidth * this->right +
+                 (T(2) * t - T(1)) * halfHeight * this->up;
+  RayT<T> r;
+  r.origin = this->pos;
+  r.direction = glm::normalize(dir);
+  return r;
+}
+
+template <typename T>
+RayDifferentialT<T> CameraT<T>::getRayDifferential(T s, T t, T aspect, T ds,
+                                                   T dt) const {
+  // primary ray with the rays through the next pixel in x and in y, they
+  // share the origin of a pinhole camera
+  RayDifferentialT<T> r;
+  RayT<T> center = this->getRay(s, t, aspect);
+  r.origin = center.origin;
+  r.direction = center.direction;
+  r.rxOrigin = this->pos;
+  r.ryOrigin = this->pos;
+  r.rxDirection = this->getRay(s + ds, t, aspect).direction;
+  r.ryDirection = this->getRay(s, t + dt, aspect).direction;
+  r.hasDifferentials = true;
+  return r;
+}
+
+using Camera = CameraT<float>;
+
 class FpsCamera : public Camera {
   void processKeyboard(Camera_Movement direction, float deltaTime) override;
 };
 
-void FpsCamera::processKeyboard(Camera_Movement direction, float deltaTime) {
+inline void FpsCamera::processKeyboard(Camera_Movement direction,
+                                       float deltaTime) {
   float velocity = this->movementSpeed * deltaTime;
   switch (direction) {
   case FORWARD:
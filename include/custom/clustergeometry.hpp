@@ -0,0 +1,557 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef CLUSTERGEOMETRY_HPP
+#define CLUSTERGEOMETRY_HPP
+
+#include <custom/bounds.hpp>
+#include <custom/geometry.hpp>
+#include <custom/mappedfile.hpp>
+#include <custom/triangle.hpp>
+#include <custom/weld.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const uint32_t CLUSTER_FILE_MAGIC = 0x4c434949u; // "IICL"
+const uint32_t CLUSTER_FILE_VERSION = 1;
+// clusters start on a page so one can be dropped without its neighbours
+const uint64_t CLUSTER_ALIGNMENT = 4096;
+
+// index check of a cluster, see ClusterGeometry
+enum ClusterIndexState : uint8_t {
+  CLUSTER_UNCHECKED,
+  CLUSTER_INDICES_VALID,
+  CLUSTER_INDICES_INVALID
+};
+
+struct ClusterSettings {
+  // triangles of a cluster are tested one by one, keep it small
+  unsigned int maxTriangles = 128;
+};
+
+struct ClusterFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t clusterCount;
+  uint64_t triangleCount;
+};
+
+/* A cluster is a self contained piece of geometry: local vertex streams,
+   indices into them and a material per triangle, laid out in this order
+   at offset in the file.
+ */
+struct ClusterRecord {
+  Bounds bounds;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t vertexCount;
+  uint32_t triangleCount;
+};
+
+struct GeometryHit {
+  float t;
+  glm::vec3 point;
+  // interpolated vertex normal, the face normal where there is none
+  glm::vec3 normal;
+  glm::vec2 uv;
+  int materialId;
+};
+
+struct StreamingSettings {
+  // bytes of cluster data kept resident
+  std::size_t memoryBudget = std::size_t(256) << 20;
+};
+
+struct StreamingStats {
+  unsigned long acquires = 0;
+  unsigned long pageIns = 0;
+  unsigned long evictions = 0;
+  // time rays spent waiting for clusters to page in
+  double stallSeconds = 0.0;
+  std::size_t residentBytes = 0;
+  std::size_t peakResidentBytes = 0;
+};
+
+inline bool writeClusterFile(const std::string &path, const GeometryView &g,
+                             const ClusterSettings &settings =
+                                 ClusterSettings()) {
+  /* Triangles are sorted along a morton curve of their centroids and cut
+     into clusters of maxTriangles, so a cluster covers a compact region
+     and its bounds stay tight. Only one cluster is held in memory while
+     writing, the source can itself be a mapped mesh cache.
+   */
+  std::size_t triangleCount = g.getTriangleCount();
+  Bounds centroidBounds;
+  std::vector<glm::vec3> centroids(triangleCount);
+  for (std::size_t t = 0; t < triangleCount; t++) {
+    glm::vec3 a, b, c;
+    g.getTriangle(t, a, b, c);
+    centroids[t] = (a + b + c) / 3.0f;
+    centroidBounds.grow(centroids[t]);
+  }
+  glm::vec3 extent = centroidBounds.getExtent();
+  glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                      extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                      extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+  std::vector<uint32_t> codes(triangleCount);
+  std::vector<uint32_t> order(triangleCount);
+  for (std::size_t t = 0; t < triangleCount; t++) {
+    codes[t] = mortonCode((centroids[t] - centroidBounds.lo) * invExtent);
+    order[t] = static_cast<uint32_t>(t);
+  }
+  std::vector<glm::vec3>().swap(centroids);
+  std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+  std::vector<uint32_t>().swap(codes);
+
+  unsigned int maxTriangles = std::max(settings.maxTriangles, 1u);
+  std::size_t clusterCount = (triangleCount + maxTriangles - 1) / maxTriangles;
+  std::vector<ClusterRecord> records(clusterCount);
+
+  // written to a temporary file and renamed, like the mesh cache, so an
+  // interrupted write never leaves a torn file for the next run to map
+  std::string tempPath = path + ".tmp";
+  std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+  ClusterFileHeader header{};
+  header.magic = CLUSTER_FILE_MAGIC;
+  header.version = CLUSTER_FILE_VERSION;
+  header.clusterCount = clusterCount;
+  header.triangleCount = triangleCount;
+  // the table is written again once the offsets are known
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(records.data()),
+            static_cast<std::streamsize>(records.size() *
+                                         sizeof(ClusterRecord)));
+  uint64_t written = sizeof(header) + records.size() * sizeof(ClusterRecord);
+
+  const uint32_t NOT_LOCAL = ~0u;
+  std::vector<uint32_t> localIndex(g.vertexCount, NOT_LOCAL);
+  std::vector<uint32_t> globalIndex;
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<uint32_t> indices;
+  std::vector<int32_t> materials;
+  const char padding[CLUSTER_ALIGNMENT] = {};
+  for (std::size_t k = 0; k < clusterCount; k++) {
+    std::size_t first = k * maxTriangles;
+    std::size_t last = std::min(first + maxTriangles, triangleCount);
+    globalIndex.clear();
+    indices.clear();
+    materials.clear();
+    ClusterRecord &r = records[k];
+    r.bounds = Bounds();
+    for (std::size_t i = first; i < last; i++) {
+      uint32_t t = order[i];
+      for (unsigned int corner = 0; corner < 3; corner++) {
+        uint32_t v = g.indices[3 * t + corner];
+        if (localIndex[v] == NOT_LOCAL) {
+          localIndex[v] = static_cast<uint32_t>(globalIndex.size());
+          globalIndex.push_back(v);
+          r.bounds.grow(g.positions[v]);
+        }
+        indices.push_back(localIndex[v]);
+      }
+      materials.push_back(g.triangleMaterials[t]);
+    }
+    positions.resize(globalIndex.size());
+    normals.resize(globalIndex.size());
+    uvs.resize(globalIndex.size());
+    for (std::size_t i = 0; i < globalIndex.size(); i++) {
+      uint32_t v = globalIndex[i];
+      positions[i] = g.positions[v];
+      normals[i] = g.normals[v];
+      uvs[i] = g.uvs[v];
+      localIndex[v] = NOT_LOCAL;
+    }
+
+    uint64_t offset = (written + CLUSTER_ALIGNMENT - 1) / CLUSTER_ALIGNMENT *
+                      CLUSTER_ALIGNMENT;
+    out.write(padding, static_cast<std::streamsize>(offset - written));
+    auto writeArray = [&out](const auto &array) {
+      out.write(reinterpret_cast<const char *>(array.data()),
+                static_cast<std::streamsize>(array.size() *
+                                             sizeof(array[0])));
+      return array.size() * sizeof(array[0]);
+    };
+    uint64_t size = writeArray(positions) + writeArray(normals) +
+                    writeArray(uvs) + writeArray(indices) +
+                    writeArray(materials);
+    r.offset = offset;
+    r.size = size;
+    r.vertexCount = static_cast<uint32_t>(globalIndex.size());
+    r.triangleCount = static_cast<uint32_t>(last - first);
+    written = offset + size;
+  }
+  out.seekp(sizeof(header));
+  out.write(reinterpret_cast<const char *>(records.data()),
+            static_cast<std::streamsize>(records.size() *
+                                         sizeof(ClusterRecord)));
+  out.close();
+  std::error_code err;
+  if (!out) {
+    std::filesystem::remove(tempPath, err);
+    return false;
+  }
+  std::filesystem::rename(tempPath, path, err);
+  if (err) {
+    std::filesystem::remove(tempPath, err);
+    return false;
+  }
+  return true;
+}
+
+/* Triangle geometry streamed from a cluster file.
+   The file is mapped whole but only the clusters rays reach are paged in,
+   and a clock sweep drops the least recently used ones with madvise when
+   the resident bytes would exceed the memory budget. A bvh over the
+   cluster bounds, with one cluster per leaf, stays in memory.
+   Resident clusters are found without locking. Dropping a cluster while
+   another thread reads it is safe, the mapping stays valid and the pages
+   are read again, so clusters are never pinned.
+   open only checks the cluster table. The indices of a cluster are
+   checked against its vertex count the first time it is acquired, while
+   its pages are faulted in anyway; a cluster that fails is never hit.
+ */
+class ClusterGeometry {
+public:
+  StreamingSettings settings;
+
+  ClusterGeometry(const StreamingSettings &s = StreamingSettings())
+      : settings(s) {}
+
+  // false if the file is missing, from another version or truncated
+  bool open(const std::string &path);
+  std::size_t getClusterCount() const { return this->clusterCount; }
+  std::size_t getTriangleCount() const;
+  Bounds getBounds() const;
+
+  bool intersect(const Ray &ray, float tmin, float tmax, GeometryHit &hit);
+  StreamingStats getStats();
+
+private:
+  struct Node {
+    Bounds bounds;
+    // children are at child and child + 1, leaves have no child
+    int32_t child;
+    int32_t cluster;
+  };
+  struct ClusterView {
+    // false when the indices of the cluster point past its vertices
+    bool valid;
+    const glm::vec3 *positions;
+    const glm::vec3 *normals;
+    const glm::vec2 *uvs;
+    const uint32_t *indices;
+    const int32_t *materials;
+  };
+
+  MappedFile file;
+  const ClusterRecord *records = nullptr;
+  std::size_t clusterCount = 0;
+  std::vector<Node> nodes;
+
+  // resident set, the flags are read without the mutex
+  std::unique_ptr<std::atomic<bool>[]> resident;
+  std::unique_ptr<std::atomic<bool>[]> referenced;
+  // CLUSTER_UNCHECKED until the indices of a cluster were checked once
+  std::unique_ptr<std::atomic<uint8_t>[]> indexState;
+  std::mutex mutex;
+  std::size_t clockHand = 0;
+  std::atomic<unsigned long> acquireCount{0};
+  std::atomic<uint64_t> stallNanoseconds{0};
+  StreamingStats stats;
+
+  void buildNode(std::vector<uint32_t> &ids, std::size_t begin,
+                 std::size_t end, std::size_t node);
+  ClusterView acquire(uint32_t cluster);
+  void evictFor(std::size_t bytes);
+};
+
+inline bool ClusterGeometry::open(const std::string &path) {
+  if (!this->file.open(path)) {
+    return false;
+  }
+  const ClusterFileHeader *header =
+      reinterpret_cast<const ClusterFileHeader *>(this->file.data());
+  bool valid = this->file.size() >= sizeof(ClusterFileHeader) &&
+               header->magic == CLUSTER_FILE_MAGIC &&
+               header->version == CLUSTER_FILE_VERSION &&
+               header->clusterCount <=
+                   (this->file.size() - sizeof(ClusterFileHeader)) /
+                       sizeof(ClusterRecord);
+  const ClusterRecord *table = reinterpret_cast<const ClusterRecord *>(
+      this->file.data() + sizeof(ClusterFileHeader));
+  for (uint64_t k = 0; valid && k < header->clusterCount; k++) {
+    const ClusterRecord &r = table[k];
+    uint64_t expected = uint64_t(r.vertexCount) * (2 * sizeof(glm::vec3) +
+                                                   sizeof(glm::vec2)) +
+                        uint64_t(r.triangleCount) * 4 * sizeof(uint32_t);
+    valid = r.offset % CLUSTER_ALIGNMENT == 0 &&
+            r.offset <= this->file.size() && r.size == expected &&
+            r.size <= this->file.size() - r.offset;
+  }
+  if (!valid) {
+    this->file.close();
+    return false;
+  }
+  this->records = table;
+  this->clusterCount = header->clusterCount;
+  this->resident.reset(new std::atomic<bool>[this->clusterCount]);
+  this->referenced.reset(new std::atomic<bool>[this->clusterCount]);
+  this->indexState.reset(new std::atomic<uint8_t>[this->clusterCount]);
+  for (std::size_t k = 0; k < this->clusterCount; k++) {
+    this->resident[k].store(false);
+    this->referenced[k].store(false);
+    this->indexState[k].store(CLUSTER_UNCHECKED);
+  }
+  this->stats = StreamingStats();
+
+  this->nodes.clear();
+  if (this->clusterCount > 0) {
+    std::vector<uint32_t> ids(this->clusterCount);
+    for (std::size_t k = 0; k < this->clusterCount; k++) {
+      ids[k] = static_cast<uint32_t>(k);
+    }
+    this->nodes.reserve(2 * this->clusterCount);
+    this->nodes.push_back(Node());
+    this->buildNode(ids, 0, ids.size(), 0);
+  }
+  return true;
+}
+
+inline void ClusterGeometry::buildNode(std::vector<uint32_t> &ids,
+                                       std::size_t begin, std::size_t end,
+                                       std::size_t node) {
+  // median split of the cluster centers along the widest axis
+  Bounds bounds;
+  Bounds centers;
+  for (std::size_t i = begin; i < end; i++) {
+    bounds.grow(this->records[ids[i]].bounds);
+    centers.grow(this->records[ids[i]].bounds.getCenter());
+  }
+  this->nodes[node].bounds = bounds;
+  if (end - begin == 1) {
+    this->nodes[node].child = -1;
+    this->nodes[node].cluster = static_cast<int32_t>(ids[begin]);
+    return;
+  }
+  glm::vec3 extent = centers.getExtent();
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                 : (extent.y > extent.z ? 1 : 2);
+  std::size_t mid = (begin + end) / 2;
+  std::nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+                   [&](uint32_t a, uint32_t b) {
+                     return this->records[a].bounds.getCenter()[axis] <
+                            this->records[b].bounds.getCenter()[axis];
+                   });
+  std::size_t child = this->nodes.size();
+  this->nodes[node].child = static_cast<int32_t>(child);
+  this->nodes[node].cluster = -1;
+  this->nodes.push_back(Node());
+  this->nodes.push_back(Node());
+  this->buildNode(ids, begin, mid, child);
+  this->buildNode(ids, mid, end, child + 1);
+}
+
+inline std::size_t ClusterGeometry::getTriangleCount() const {
+  if (!this->file.isOpen()) {
+    return 0;
+  }
+  return reinterpret_cast<const ClusterFileHeader *>(this->file.data())
+      ->triangleCount;
+}
+
+inline Bounds ClusterGeometry::getBounds() const {
+  return this->nodes.empty() ? Bounds() : this->nodes[0].bounds;
+}
+
+inline void ClusterGeometry::evictFor(std::size_t bytes) {
+  /* Clock sweep, called with the mutex held. A referenced cluster gets a
+     second chance, the first unreferenced one is dropped. Two turns of
+     the hand clear every reference bit, so the loop always ends.
+   */
+  for (std::size_t step = 0;
+       step < 2 * this->clusterCount &&
+       this->stats.residentBytes + bytes > this->settings.memoryBudget &&
+       this->stats.residentBytes > 0;
+       step++) {
+    std::size_t k = this->clockHand;
+    this->clockHand = (this->clockHand + 1) % this->clusterCount;
+    if (!this->resident[k].load(std::memory_order_relaxed)) {
+      continue;
+    }
+    if (this->referenced[k].exchange(false, std::memory_order_relaxed)) {
+      continue;
+    }
+    this->resident[k].store(false, std::memory_order_relaxed);
+    this->file.dontNeed(this->records[k].offset, this->records[k].size);
+    this->stats.residentBytes -= this->records[k].size;
+    this->stats.evictions++;
+  }
+}
+
+inline ClusterGeometry::ClusterView ClusterGeometry::acquire(uint32_t k) {
+  const ClusterRecord &r = this->records[k];
+  this->acquireCount.fetch_add(1, std::memory_order_relaxed);
+  if (!this->resident[k].load(std::memory_order_relaxed)) {
+    auto start = std::chrono::steady_clock::now();
+    bool pageIn = false;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->resident[k].load(std::memory_order_relaxed)) {
+        this->evictFor(r.size);
+        this->resident[k].store(true, std::memory_order_relaxed);
+        this->stats.residentBytes += r.size;
+        this->stats.peakResidentBytes = std::max(
+            this->stats.peakResidentBytes, this->stats.residentBytes);
+        this->stats.pageIns++;
+        pageIn = true;
+      }
+    }
+    if (pageIn) {
+      // fault the whole cluster in now instead of page by page in the loop
+      this->file.willNeed(r.offset, r.size);
+      const volatile unsigned char *bytes = this->file.data() + r.offset;
+      std::size_t page = MappedFile::getPageSize();
+      for (std::size_t i = 0; i < r.size; i += page) {
+        (void)bytes[i];
+      }
+    }
+    std::chrono::nanoseconds elapsed =
+        std::chrono::steady_clock::now() - start;
+    this->stallNanoseconds.fetch_add(
+        static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+  }
+  this->referenced[k].store(true, std::memory_order_relaxed);
+
+  const unsigned char *p = this->file.data() + r.offset;
+  ClusterView view;
+  view.positions = reinterpret_cast<const glm::vec3 *>(p);
+  p += r.vertexCount * sizeof(glm::vec3);
+  view.normals = reinterpret_cast<const glm::vec3 *>(p);
+  p += r.vertexCount * sizeof(glm::vec3);
+  view.uvs = reinterpret_cast<const glm::vec2 *>(p);
+  p += r.vertexCount * sizeof(glm::vec2);
+  view.indices = reinterpret_cast<const uint32_t *>(p);
+  p += r.triangleCount * 3 * sizeof(uint32_t);
+  view.materials = reinterpret_cast<const int32_t *>(p);
+
+  // the file does not change while mapped, racing checks agree
+  uint8_t state = this->indexState[k].load(std::memory_order_acquire);
+  if (state == CLUSTER_UNCHECKED) {
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < 3 * r.triangleCount; i++) {
+      largest = std::max(largest, view.indices[i]);
+    }
+    state = r.triangleCount == 0 || largest < r.vertexCount
+                ? CLUSTER_INDICES_VALID
+                : CLUSTER_INDICES_INVALID;
+    this->indexState[k].store(state, std::memory_order_release);
+  }
+  view.valid = state == CLUSTER_INDICES_VALID;
+  return view;
+}
+
+inline bool ClusterGeometry::intersect(const Ray &ray, float tmin, float tmax,
+                                       GeometryHit &hit) {
+  if (this->nodes.empty()) {
+    return false;
+  }
+  glm::vec3 invDirection = 1.0f / ray.direction;
+  /* Near child first: once a hit shortens tmax, the nodes still on the
+     stack that start behind it are dropped without touching, and without
+     paging in, their clusters.
+   */
+  struct Entry {
+    int32_t node;
+    float t;
+  };
+  Entry stack[64];
+  int top = 0;
+  float rootT;
+  if (!this->nodes[0].bounds.hit(ray, invDirection, tmin, tmax, rootT)) {
+    return false;
+  }
+  stack[top++] = Entry{0, rootT};
+  bool found = false;
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.t > tmax) {
+      continue;
+    }
+    const Node &node = this->nodes[entry.node];
+    if (node.child >= 0) {
+      float t0, t1;
+      bool hit0 = this->nodes[node.child].bounds.hit(ray, invDirection, tmin,
+                                                     tmax, t0);
+      bool hit1 = this->nodes[node.child + 1].bounds.hit(ray, invDirection,
+                                                         tmin, tmax, t1);
+      if (hit0 && hit1) {
+        Entry near{node.child, t0}, far{node.child + 1, t1};
+        if (t1 < t0) {
+          std::swap(near, far);
+        }
+        stack[top++] = far;
+        stack[top++] = near;
+      } else if (hit0) {
+        stack[top++] = Entry{node.child, t0};
+      } else if (hit1) {
+        stack[top++] = Entry{node.child + 1, t1};
+      }
+      continue;
+    }
+    // only leaves the ray reaches page their cluster in
+    uint32_t k = static_cast<uint32_t>(node.cluster);
+    ClusterView c = this->acquire(k);
+    if (!c.valid) {
+      continue;
+    }
+    for (uint32_t i = 0; i < this->records[k].triangleCount; i++) {
+      const uint32_t *tri = &c.indices[3 * i];
+      Triangle triangle{c.positions[tri[0]], c.positions[tri[1]],
+                        c.positions[tri[2]]};
+      float t, u, v;
+      if (!triangle.hit(ray, tmin, tmax, t, u, v)) {
+        continue;
+      }
+      found = true;
+      tmax = t;
+      float w = 1.0f - u - v;
+      hit.t = t;
+      hit.point = ray.at(t);
+      hit.normal = w * c.normals[tri[0]] + u * c.normals[tri[1]] +
+                   v * c.normals[tri[2]];
+      if (glm::dot(hit.normal, hit.normal) < 1.0e-12f) {
+        hit.normal = glm::cross(triangle.b - triangle.a,
+                                triangle.c - triangle.a);
+      }
+      hit.normal = glm::normalize(hit.normal);
+      hit.uv = w * c.uvs[tri[0]] + u * c.uvs[tri[1]] + v * c.uvs[tri[2]];
+      hit.materialId = c.materials[i];
+    }
+  }
+  return found;
+}
+
+inline StreamingStats ClusterGeometry::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  StreamingStats s = this->stats;
+  s.acquires = this->acquireCount.load();
+  s.stallSeconds = this->stallNanoseconds.load() * 1.0e-9;
+  return s;
+}
+
+#endif
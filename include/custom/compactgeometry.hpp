@@ -0,0 +1,216 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef COMPACTGEOMETRY_HPP
+#define COMPACTGEOMETRY_HPP
+
+#include <custom/geometry.hpp>
+#include <custom/parallel.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// octahedral mapping of a unit vector to [-1, 1]^2
+inline glm::vec2 octEncode(glm::vec3 n) {
+  float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (sum == 0.0f) {
+    // missing normals come back as +z
+    return glm::vec2(0.0f);
+  }
+  n /= sum;
+  glm::vec2 p(n.x, n.y);
+  if (n.z < 0.0f) {
+    // fold the lower hemisphere over the diagonals
+    p = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return p;
+}
+
+inline glm::vec3 octDecode(glm::vec2 p) {
+  glm::vec3 n(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+  float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return glm::normalize(n);
+}
+
+inline uint32_t packNormal(glm::vec3 n) {
+  return glm::packSnorm2x16(octEncode(n));
+}
+inline glm::vec3 unpackNormal(uint32_t p) {
+  return octDecode(glm::unpackSnorm2x16(p));
+}
+
+// positions of a mesh are stored as 16 bit offsets inside its bounds
+struct CompactMeshBounds {
+  glm::vec3 origin = glm::vec3(0.0f);
+  glm::vec3 extent = glm::vec3(0.0f);
+};
+
+/* SceneGeometry with compressed vertex streams.
+   Positions take 6 bytes, quantized to the bounds of their mesh, normals
+   are octahedral snorm pairs in 4 bytes and uvs two half floats in 4
+   bytes: 14 bytes per vertex against 32 for the float streams. Vertices
+   of meshes with tangent frames add 8 bytes for the two octahedral
+   vectors against 24. Indices, triangle materials, meshes and materials
+   are kept as they are, the bounds of every mesh are added.
+   Everything is decoded where it is read, so intersection pays for
+   dequantizing positions and shading for unpacking the hit vertices.
+ */
+struct CompactGeometry {
+  std::vector<glm::u16vec3> positions;
+  std::vector<uint32_t> normals;
+  std::vector<uint32_t> uvs;
+  std::vector<uint32_t> tangents;
+  std::vector<uint32_t> bitangents;
+  std::vector<unsigned int> indices;
+  std::vector<int> triangleMaterials;
+  std::vector<GeometryMesh> meshes;
+  std::vector<CompactMeshBounds> bounds;
+  std::vector<GeometryMaterial> materials;
+
+  CompactGeometry() {}
+  CompactGeometry(const SceneGeometry &geometry) { encode(geometry); }
+
+  void encode(const SceneGeometry &geometry);
+
+  std::size_t getVertexCount() const { return this->positions.size(); }
+  std::size_t getTriangleCount() const { return this->indices.size() / 3; }
+  /* bytes of the arrays, the same ones SceneGeometry::getMemorySize
+     counts plus the mesh bounds
+   */
+  std::size_t getMemorySize() const;
+
+  // mesh containing a triangle, a binary search over the index ranges
+  std::size_t findMesh(std::size_t triangle) const;
+  glm::vec3 getPosition(std::size_t mesh, unsigned int vertex) const;
+  glm::vec3 getNormal(unsigned int vertex) const;
+  glm::vec2 getUv(unsigned int vertex) const;
+  // false when the mesh has no tangent frames
+  bool getTangentFrame(std::size_t mesh, unsigned int vertex,
+                       glm::vec3 &tangent, glm::vec3 &bitangent) const;
+  void getTriangle(std::size_t triangle, glm::vec3 &a, glm::vec3 &b,
+                   glm::vec3 &c) const;
+};
+
+inline void CompactGeometry::encode(const SceneGeometry &g) {
+  this->indices = g.indices;
+  this->triangleMaterials = g.triangleMaterials;
+  this->meshes = g.meshes;
+  this->materials = g.materials;
+  this->bounds.assign(g.meshes.size(), CompactMeshBounds());
+  this->positions.resize(g.positions.size());
+  this->normals.resize(g.normals.size());
+  this->uvs.resize(g.uvs.size());
+  this->tangents.resize(g.tangents.size());
+  this->bitangents.resize(g.bitangents.size());
+
+  // meshes own disjoint vertex ranges, so they are encoded concurrently
+  parallelFor(
+      0, g.meshes.size(),
+      [&](std::size_t m) {
+        const GeometryMesh &mesh = g.meshes[m];
+        if (mesh.vertexCount == 0) {
+          return;
+        }
+        const glm::vec3 *p = &g.positions[mesh.firstVertex];
+        glm::vec3 lo = p[0];
+        glm::vec3 hi = p[0];
+        for (unsigned int i = 1; i < mesh.vertexCount; i++) {
+          lo = glm::min(lo, p[i]);
+          hi = glm::max(hi, p[i]);
+        }
+        CompactMeshBounds &b = this->bounds[m];
+        b.origin = lo;
+        b.extent = hi - lo;
+        // flat axes quantize to zero instead of dividing by zero
+        glm::vec3 invExtent(b.extent.x > 0.0f ? 1.0f / b.extent.x : 0.0f,
+                            b.extent.y > 0.0f ? 1.0f / b.extent.y : 0.0f,
+                            b.extent.z > 0.0f ? 1.0f / b.extent.z : 0.0f);
+        for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+          unsigned int v = mesh.firstVertex + i;
+          this->positions[v] =
+              glm::packUnorm<uint16_t>((g.positions[v] - lo) * invExtent);
+          this->normals[v] = packNormal(g.normals[v]);
+          this->uvs[v] = glm::packHalf2x16(g.uvs[v]);
+        }
+        if (mesh.hasTangents()) {
+          for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+            unsigned int v = mesh.firstTangent + i;
+            this->tangents[v] = packNormal(g.tangents[v]);
+            this->bitangents[v] = packNormal(g.bitangents[v]);
+          }
+        }
+      },
+      0, 1);
+}
+
+inline std::size_t CompactGeometry::getMemorySize() const {
+  return this->positions.size() * sizeof(glm::u16vec3) +
+         this->normals.size() * sizeof(uint32_t) +
+         this->uvs.size() * sizeof(uint32_t) +
+         this->tangents.size() * sizeof(uint32_t) +
+         this->bitangents.size() * sizeof(uint32_t) +
+         this->indices.size() * sizeof(unsigned int) +
+         this->triangleMaterials.size() * sizeof(int) +
+         this->meshes.size() * sizeof(GeometryMesh) +
+         this->materials.size() * sizeof(GeometryMaterial) +
+         this->bounds.size() * sizeof(CompactMeshBounds);
+}
+
+inline std::size_t CompactGeometry::findMesh(std::size_t triangle) const {
+  // last mesh whose first index is not past the triangle
+  auto it = std::upper_bound(
+      this->meshes.begin(), this->meshes.end(), 3 * triangle,
+      [](std::size_t index, const GeometryMesh &mesh) {
+        return index < mesh.firstIndex;
+      });
+  return static_cast<std::size_t>(it - this->meshes.begin()) - 1;
+}
+
+inline glm::vec3 CompactGeometry::getPosition(std::size_t mesh,
+                                              unsigned int vertex) const {
+  const CompactMeshBounds &b = this->bounds[mesh];
+  return b.origin +
+         glm::unpackUnorm<float>(this->positions[vertex]) * b.extent;
+}
+
+inline glm::vec3 CompactGeometry::getNormal(unsigned int vertex) const {
+  return unpackNormal(this->normals[vertex]);
+}
+
+inline glm::vec2 CompactGeometry::getUv(unsigned int vertex) const {
+  return glm::unpackHalf2x16(this->uvs[vertex]);
+}
+
+inline bool CompactGeometry::getTangentFrame(std::size_t mesh,
+                                             unsigned int vertex,
+                                             glm::vec3 &tangent,
+                                             glm::vec3 &bitangent) const {
+  const GeometryMesh &m = this->meshes[mesh];
+  if (!m.hasTangents()) {
+    return false;
+  }
+  unsigned int v = m.firstTangent + (vertex - m.firstVertex);
+  tangent = unpackNormal(this->tangents[v]);
+  bitangent = unpackNormal(this->bitangents[v]);
+  return true;
+}
+
+inline void CompactGeometry::getTriangle(std::size_t triangle, glm::vec3 &a,
+                                         glm::vec3 &b, glm::vec3 &c) const {
+  std::size_t mesh = this->findMesh(triangle);
+  const unsigned int *tri = &this->indices[3 * triangle];
+  a = this->getPosition(mesh, tri[0]);
+  b = this->getPosition(mesh, tri[1]);
+  c = this->getPosition(mesh, tri[2]);
+}
+
+#endif
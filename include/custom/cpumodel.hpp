@@ -0,0 +1,245 @@
+// declare the include guard
+#ifndef CPUMODEL_HPP
+#define CPUMODEL_HPP
+
+// declare libs
+// flat geometry arrays
+#include <custom/geometry.hpp>
+#include <custom/meshcache.hpp>
+#include <custom/parallel.hpp>
+#include <custom/tangents.hpp>
+#include <custom/weld.hpp>
+
+// assimp model loading library
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+//
+#include <iostream>
+#include <string>
+#include <vector>
+
+// end declare libs
+
+/* Model loader for the ray tracer.
+   Same assimp import as Model but without any opengl: meshes are written
+   straight into the flat arrays of a SceneGeometry, there is no Vertex or
+   Mesh in between and textures are only recorded by path. It can run on
+   machines without a gl context.
+   The result of an import is saved next to the model as a mesh cache, a
+   later load of the unchanged file maps the cache instead of running
+   assimp. Read geometry through getGeometry, which points into the cache
+   on a warm load; geometry only holds the arrays after an import.
+   Tangent frames are not asked from assimp, processMesh computes them for
+   the normal mapped meshes only.
+ */
+const unsigned int CPU_MODEL_IMPORT_FLAGS =
+    aiProcess_Triangulate | aiProcess_FlipUVs;
+
+class CpuModel {
+public:
+  SceneGeometry geometry;
+  std::string directory;
+  // reduction of the import, left empty by a warm load
+  WeldStats weldStats;
+  // constructor
+  CpuModel(const char *path, bool useCache = true) {
+    loadModel(path, useCache);
+  }
+
+  GeometryView getGeometry() const;
+  bool isCached() const { return this->cache.isOpen(); }
+
+private:
+  MeshCache cache;
+
+  // functions
+  void loadModel(std::string path, bool useCache);
+  void processNode(aiNode *node, const aiScene *scene,
+                   std::vector<aiMesh *> &work);
+  void processMesh(aiMesh *mesh, const GeometryMesh &range);
+  void processMaterials(const aiScene *scene);
+  bool needsTangents(const aiMesh *mesh) const;
+};
+
+// defining methods
+inline GeometryView CpuModel::getGeometry() const {
+  return this->cache.isOpen() ? this->cache.getView()
+                              : this->geometry.getView();
+}
+
+inline void CpuModel::loadModel(std::string path, bool useCache) {
+  directory = path.substr(0, path.find_last_of('/'));
+  MeshCacheKey key;
+  bool hasKey = useCache &&
+                makeMeshCacheKey(path, CPU_MODEL_IMPORT_FLAGS, key);
+  if (hasKey && this->cache.open(getMeshCachePath(path), key)) {
+    this->geometry.materials = this->cache.getMaterials();
+    return;
+  }
+
+  // read the file with assimp, same flags as Model
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(path, CPU_MODEL_IMPORT_FLAGS);
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+      !scene->mRootNode) {
+    std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+    return;
+  }
+
+  // flatten the node tree into the list of meshes to convert
+  std::vector<aiMesh *> work;
+  this->processNode(scene->mRootNode, scene, work);
+
+  // count the triangles of every mesh, only faces with 3 indices are kept
+  std::vector<unsigned int> triangleCounts(work.size());
+  parallelFor(
+      0, work.size(),
+      [&](std::size_t m) {
+        unsigned int count = 0;
+        for (unsigned int f = 0; f < work[m]->mNumFaces; f++) {
+          count += work[m]->mFaces[f].mNumIndices == 3 ? 1 : 0;
+        }
+        triangleCounts[m] = count;
+      },
+      0, 1);
+
+  // the materials decide which meshes keep their tangent frames
+  this->processMaterials(scene);
+
+  // prefix sums give every mesh its own range in the flat arrays
+  SceneGeometry &g = this->geometry;
+  g.meshes.resize(work.size());
+  unsigned int vertexCount = 0;
+  unsigned int indexCount = 0;
+  unsigned int tangentCount = 0;
+  for (std::size_t m = 0; m < work.size(); m++) {
+    GeometryMesh &range = g.meshes[m];
+    range.firstVertex = vertexCount;
+    range.vertexCount = work[m]->mNumVertices;
+    range.firstIndex = indexCount;
+    range.indexCount = 3 * triangleCounts[m];
+    range.materialId = static_cast<int>(work[m]->mMaterialIndex);
+    if (this->needsTangents(work[m])) {
+      range.firstTangent = tangentCount;
+      tangentCount += range.vertexCount;
+    }
+    vertexCount += range.vertexCount;
+    indexCount += range.indexCount;
+  }
+  g.positions.resize(vertexCount);
+  g.normals.resize(vertexCount);
+  g.uvs.resize(vertexCount);
+  g.tangents.resize(tangentCount);
+  g.bitangents.resize(tangentCount);
+  g.indices.resize(indexCount);
+  g.triangleMaterials.resize(indexCount / 3);
+
+  // ranges do not overlap so the meshes are filled concurrently
+  parallelFor(
+      0, work.size(),
+      [&](std::size_t m) { this->processMesh(work[m], g.meshes[m]); }, 0, 1);
+
+  // assimp duplicates a vertex for every face using it
+  this->weldStats = VertexWelder().weld(g);
+
+  // a cache that can not be written only costs the next load an import
+  if (hasKey && !writeMeshCache(getMeshCachePath(path), key, g)) {
+    std::cout << "WARNING::MESHCACHE::could not write "
+              << getMeshCachePath(path) << std::endl;
+  }
+}
+
+inline void CpuModel::processNode(aiNode *node, const aiScene *scene,
+                                  std::vector<aiMesh *> &work) {
+  // same traversal order as Model::processNode
+  for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+    work.push_back(scene->mMeshes[node->mMeshes[i]]);
+  }
+  for (unsigned int k = 0; k < node->mNumChildren; k++) {
+    this->processNode(node->mChildren[k], scene, work);
+  }
+}
+
+inline void CpuModel::processMesh(aiMesh *mesh, const GeometryMesh &range) {
+  SceneGeometry &g = this->geometry;
+
+  // every stream is written in place, missing attributes are zero
+  const unsigned int n = mesh->mNumVertices;
+  glm::vec3 *positions = &g.positions[range.firstVertex];
+  for (unsigned int i = 0; i < n; i++) {
+    positions[i] = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
+                             mesh->mVertices[i].z);
+  }
+  glm::vec3 *normals = &g.normals[range.firstVertex];
+  for (unsigned int i = 0; i < n; i++) {
+    normals[i] = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x,
+                                            mesh->mNormals[i].y,
+                                            mesh->mNormals[i].z)
+                                : glm::vec3(0.0f);
+  }
+  glm::vec2 *uvs = &g.uvs[range.firstVertex];
+  const aiVector3D *texCoords = mesh->mTextureCoords[0];
+  for (unsigned int i = 0; i < n; i++) {
+    uvs[i] = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y)
+                       : glm::vec2(0.0f);
+  }
+  if (range.hasTangents()) {
+    computeTangentFrames(mesh, &g.tangents[range.firstTangent],
+                         &g.bitangents[range.firstTangent]);
+  }
+
+  // indices are offset to the global vertex array
+  unsigned int *indices = &g.indices[range.firstIndex];
+  int *materials = &g.triangleMaterials[range.firstIndex / 3];
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    const aiFace &face = mesh->mFaces[i];
+    if (face.mNumIndices != 3) {
+      // points and lines survive triangulation, they have no area
+      continue;
+    }
+    for (unsigned int k = 0; k < 3; k++) {
+      *indices++ = range.firstVertex + face.mIndices[k];
+    }
+    *materials++ = range.materialId;
+  }
+}
+
+inline bool CpuModel::needsTangents(const aiMesh *mesh) const {
+  // tangent frames are only read when shading a normal map, and need the
+  // normals and uvs they are derived from
+  if (!mesh->mNormals || !mesh->mTextureCoords[0] ||
+      mesh->mMaterialIndex >= this->geometry.materials.size()) {
+    return false;
+  }
+  return !this->geometry.materials[mesh->mMaterialIndex].normalPath.empty();
+}
+
+inline void CpuModel::processMaterials(const aiScene *scene) {
+  // one GeometryMaterial per assimp material, meshes refer to them by index
+  auto firstTexture = [](aiMaterial *mat, aiTextureType type) {
+    if (mat->GetTextureCount(type) == 0) {
+      return std::string();
+    }
+    aiString str;
+    mat->GetTexture(type, 0, &str);
+    return std::string(str.C_Str());
+  };
+  this->geometry.materials.resize(scene->mNumMaterials);
+  for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+    aiMaterial *mat = scene->mMaterials[i];
+    GeometryMaterial &m = this->geometry.materials[i];
+    aiColor4D diffuse;
+    if (mat->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS) {
+      m.diffuseColor = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+    }
+    // same texture slots as Model::processMesh
+    m.diffusePath = firstTexture(mat, aiTextureType_DIFFUSE);
+    m.specularPath = firstTexture(mat, aiTextureType_SPECULAR);
+    m.normalPath = firstTexture(mat, aiTextureType_HEIGHT);
+    m.heightPath = firstTexture(mat, aiTextureType_AMBIENT);
+  }
+}
+
+#endif
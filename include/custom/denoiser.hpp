@@ -0,0 +1,458 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef DENOISER_HPP
+#define DENOISER_HPP
+
+#include <custom/framebuffer.hpp>
+#include <custom/parallel.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// optional guide buffers, laid out like the framebuffer pixels
+struct DenoiseGuides {
+  const glm::vec3 *albedo = nullptr;
+  const glm::vec3 *normal = nullptr;
+  const float *depth = nullptr;
+};
+
+struct DenoiseSettings {
+  // filter radius doubles every iteration: 5 iterations cover 63 pixels
+  int iterations = 5;
+  // edge stopping strengths, larger values blur more across the edge
+  float sigmaLuminance = 4.0f;
+  float sigmaNormal = 128.0f;
+  float sigmaDepth = 1.0f;
+  float sigmaAlbedo = 0.1f;
+  unsigned int threadCount = 0;
+};
+
+/* exp and log of the cephes single precision routines, used by the filter
+   weights. The sse2 versions do the same float operations in the same
+   order as the scalar ones, so a pixel gets the same weight whether it is
+   filtered in a vector lane or in the scalar tail. log expects x > 0 and
+   not denormal.
+ */
+inline float approxExp(float x) {
+  x = std::min(std::max(x, -87.3365f), 88.3762f);
+  float n = static_cast<float>(std::lrint(x * 1.44269504f));
+  x = x - n * 0.693359375f;
+  x = x - n * -2.12194440e-4f;
+  float z = x * x;
+  float y = 1.9875691500e-4f;
+  y = y * x + 1.3981999507e-3f;
+  y = y * x + 8.3334519073e-3f;
+  y = y * x + 4.1665795894e-2f;
+  y = y * x + 1.6666665459e-1f;
+  y = y * x + 5.0000001201e-1f;
+  y = y * z + x;
+  y = y + 1.0f;
+  uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(n) + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return y * scale;
+}
+
+inline float approxLog(float x) {
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  // x = m 2^e with m in [0.5, 1)
+  float e = static_cast<float>(static_cast<int32_t>(bits >> 23) - 126);
+  bits = (bits & 0x807fffffu) | 0x3f000000u;
+  float m;
+  std::memcpy(&m, &bits, sizeof(m));
+  bool small = m < 0.707106781f;
+  e = e - (small ? 1.0f : 0.0f);
+  x = m - 1.0f;
+  x = x + (small ? m : 0.0f);
+  float z = x * x;
+  float y = 7.0376836292e-2f;
+  y = y * x + -1.1514610310e-1f;
+  y = y * x + 1.1676998740e-1f;
+  y = y * x + -1.2420140846e-1f;
+  y = y * x + 1.4249322787e-1f;
+  y = y * x + -1.6668057665e-1f;
+  y = y * x + 2.0000714765e-1f;
+  y = y * x + -2.4999993993e-1f;
+  y = y * x + 3.3333331174e-1f;
+  y = y * x;
+  y = y * z;
+  y = y + e * -2.12194440e-4f;
+  y = y + -0.5f * z;
+  x = x + y;
+  return x + e * 0.693359375f;
+}
+
+#if defined(__SSE2__)
+inline __m128 approxExp(__m128 x) {
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3365f)),
+                 _mm_set1_ps(88.3762f));
+  __m128i ni = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)));
+  __m128 n = _mm_cvtepi32_ps(ni);
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+  __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, z), x);
+  y = _mm_add_ps(y, _mm_set1_ps(1.0f));
+  __m128 scale = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(ni, _mm_set1_epi32(127)), 23));
+  return _mm_mul_ps(y, scale);
+}
+
+inline __m128 approxLog(__m128 x) {
+  __m128i bits = _mm_castps_si128(x);
+  __m128 e = _mm_cvtepi32_ps(
+      _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+  __m128 m = _mm_castsi128_ps(
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x807fffff)),
+                   _mm_set1_epi32(0x3f000000)));
+  __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781f));
+  e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+  x = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+  x = _mm_add_ps(x, _mm_and_ps(small, m));
+  __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(7.0376836292e-2f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+  y = _mm_mul_ps(y, x);
+  y = _mm_mul_ps(y, z);
+  y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+  y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(-0.5f), z));
+  x = _mm_add_ps(x, y);
+  return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+#endif
+
+struct DenoiseStats {
+  double seconds = 0.0;
+  double msPerMegapixel = 0.0;
+};
+
+// edge avoiding a-trous wavelet filter (Dammertz et al. 2010) with the
+// luminance weight scaled by the pixel variance (Schied et al. 2017)
+class AtrousDenoiser {
+public:
+  DenoiseSettings settings;
+
+  AtrousDenoiser(DenoiseSettings s = DenoiseSettings()) : settings(s) {}
+  // replaces the colors of fb with their filtered version
+  template <typename T>
+  DenoiseStats denoise(FramebufferT<T> &fb,
+                       const DenoiseGuides &guides = DenoiseGuides());
+
+private:
+  int width = 0;
+  int height = 0;
+  // planar copies so the inner loops run over contiguous floats
+  std::vector<float> red, green, blue, variance;
+  std::vector<float> outRed, outGreen, outBlue, outVariance;
+  std::vector<float> albedoR, albedoG, albedoB;
+  std::vector<float> normalX, normalY, normalZ;
+  std::vector<float> depth;
+
+  // accumulators of the row being filtered, one set per thread
+  struct RowScratch {
+    std::vector<float> accR, accG, accB, accVar, weightSum, lumP, invSigmaL;
+  };
+  static RowScratch &getRowScratch(int width);
+
+  template <typename T>
+  void loadPlanes(const FramebufferT<T> &fb, const DenoiseGuides &guides);
+  void filterRow(int y, int step, const DenoiseGuides &guides);
+};
+
+template <typename T>
+void AtrousDenoiser::loadPlanes(const FramebufferT<T> &fb,
+                                const DenoiseGuides &guides) {
+  this->width = fb.width;
+  this->height = fb.height;
+  std::size_t n = fb.pixels.size();
+  for (std::vector<float> *plane :
+       {&this->red, &this->green, &this->blue, &this->variance,
+        &this->outRed, &this->outGreen, &this->outBlue, &this->outVariance}) {
+    plane->resize(n);
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    // the filter itself always runs in float
+    const PixelAccumulatorT<T> &p = fb.pixels[i];
+    this->red[i] = static_cast<float>(p.mean.x);
+    this->green[i] = static_cast<float>(p.mean.y);
+    this->blue[i] = static_cast<float>(p.mean.z);
+    // variance of the pixel estimate, not of a single sample
+    this->variance[i] =
+        p.sampleCount > 1
+            ? static_cast<float>(p.lumM2 / (T(p.sampleCount - 1) *
+                                            T(p.sampleCount)))
+            : 0.0f;
+  }
+  if (guides.albedo) {
+    this->albedoR.resize(n);
+    this->albedoG.resize(n);
+    this->albedoB.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+      this->albedoR[i] = guides.albedo[i].x;
+      this->albedoG[i] = guides.albedo[i].y;
+      this->albedoB[i] = guides.albedo[i].z;
+    }
+  }
+  if (guides.normal) {
+    this->normalX.resize(n);
+    this->normalY.resize(n);
+    this->normalZ.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+      this->normalX[i] = guides.normal[i].x;
+      this->normalY[i] = guides.normal[i].y;
+      this->normalZ[i] = guides.normal[i].z;
+    }
+  }
+  if (guides.depth) {
+    this->depth.assign(guides.depth, guides.depth + n);
+  }
+}
+
+inline AtrousDenoiser::RowScratch &AtrousDenoiser::getRowScratch(int width) {
+  static thread_local RowScratch scratch;
+  std::size_t w = static_cast<std::size_t>(width);
+  for (std::vector<float> *v :
+       {&scratch.accR, &scratch.accG, &scratch.accB, &scratch.accVar,
+        &scratch.weightSum, &scratch.lumP, &scratch.invSigmaL}) {
+    if (v->size() < w) {
+      v->resize(w);
+    }
+  }
+  return scratch;
+}
+
+inline void AtrousDenoiser::filterRow(int y, int step,
+                                      const DenoiseGuides &guides) {
+  /* Filter one row with the 5x5 B3 spline kernel dilated by step.
+     The loops are ordered tap first, pixel second: for every tap the
+     valid x range is computed up front so the inner loop is a straight
+     run over contiguous memory without border checks. That loop runs
+     four pixels at a time with sse2. The edge stopping weight is
+     h exp(-e) dot^sigmaNormal, evaluated as one exp of
+     -e + sigmaNormal log(dot); the guide tests are the same for every
+     pixel of the row.
+   */
+  static const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f,
+                                  1.0f / 4.0f, 1.0f / 16.0f};
+  const int w = this->width;
+  const int row = y * w;
+  const float *r = this->red.data();
+  const float *g = this->green.data();
+  const float *b = this->blue.data();
+  const float *var = this->variance.data();
+  const float *dep = this->depth.data();
+  const float *alR = this->albedoR.data();
+  const float *alG = this->albedoG.data();
+  const float *alB = this->albedoB.data();
+  const float *nX = this->normalX.data();
+  const float *nY = this->normalY.data();
+  const float *nZ = this->normalZ.data();
+  const bool useDepth = guides.depth != nullptr;
+  const bool useAlbedo = guides.albedo != nullptr;
+  const bool useNormal = guides.normal != nullptr;
+
+  RowScratch &s = getRowScratch(w);
+  float *accR = s.accR.data();
+  float *accG = s.accG.data();
+  float *accB = s.accB.data();
+  float *accVar = s.accVar.data();
+  float *weightSum = s.weightSum.data();
+  float *lumP = s.lumP.data();
+  float *invSigmaL = s.invSigmaL.data();
+
+  // the center tap always has full weight, which also keeps the weight sum
+  // away from zero for pixels without valid guides (the background)
+  const float center = kernel[2] * kernel[2];
+  for (int x = 0; x < w; x++) {
+    int p = row + x;
+    accR[x] = center * r[p];
+    accG[x] = center * g[p];
+    accB[x] = center * b[p];
+    accVar[x] = center * center * var[p];
+    weightSum[x] = center;
+    lumP[x] = 0.2126f * r[p] + 0.7152f * g[p] + 0.0722f * b[p];
+    invSigmaL[x] =
+        1.0f / (this->settings.sigmaLuminance * std::sqrt(var[p]) + 1.0e-4f);
+  }
+  const float invSigmaD = 1.0f / (this->settings.sigmaDepth * step);
+  const float invSigmaA = 1.0f / this->settings.sigmaAlbedo;
+  const float sigmaN = this->settings.sigmaNormal;
+  // smallest normal float, keeps log away from zero and denormals
+  const float minDot = 1.17549435e-38f;
+  /* Taps whose weight falls below exp(minArg) are dropped. Next to the
+     center tap they change nothing, and their squares in the variance sum
+     would be denormals, which cost the cpu a microcode assist each.
+   */
+  const float minArg = -20.0f;
+
+  for (int ky = -2; ky <= 2; ky++) {
+    int qy = y + ky * step;
+    if (qy < 0 || qy >= this->height) {
+      continue;
+    }
+    for (int kx = -2; kx <= 2; kx++) {
+      if (kx == 0 && ky == 0) {
+        continue;
+      }
+      int dx = kx * step;
+      int x0 = std::max(0, -dx);
+      int x1 = std::min(w, w - dx);
+      float h = kernel[ky + 2] * kernel[kx + 2];
+      int offset = (qy - y) * w + dx;
+      int x = x0;
+#if defined(__SSE2__)
+      const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+      const __m128 lr = _mm_set1_ps(0.2126f), lg = _mm_set1_ps(0.7152f),
+                   lb = _mm_set1_ps(0.0722f), hv = _mm_set1_ps(h),
+                   zero = _mm_setzero_ps(), minArgV = _mm_set1_ps(minArg);
+      for (; x + 4 <= x1; x += 4) {
+        int p = row + x;
+        int q = p + offset;
+        __m128 rq = _mm_loadu_ps(r + q);
+        __m128 gq = _mm_loadu_ps(g + q);
+        __m128 bq = _mm_loadu_ps(b + q);
+        __m128 lumQ = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(lr, rq), _mm_mul_ps(lg, gq)),
+            _mm_mul_ps(lb, bq));
+        __m128 e = _mm_mul_ps(
+            _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(lumP + x), lumQ), absMask),
+            _mm_loadu_ps(invSigmaL + x));
+        if (useDepth) {
+          __m128 dd = _mm_sub_ps(_mm_loadu_ps(dep + p), _mm_loadu_ps(dep + q));
+          e = _mm_add_ps(e, _mm_mul_ps(_mm_and_ps(dd, absMask),
+                                       _mm_set1_ps(invSigmaD)));
+        }
+        if (useAlbedo) {
+          __m128 ar = _mm_sub_ps(_mm_loadu_ps(alR + p), _mm_loadu_ps(alR + q));
+          __m128 ag = _mm_sub_ps(_mm_loadu_ps(alG + p), _mm_loadu_ps(alG + q));
+          __m128 ab = _mm_sub_ps(_mm_loadu_ps(alB + p), _mm_loadu_ps(alB + q));
+          __m128 a2 = _mm_add_ps(
+              _mm_add_ps(_mm_mul_ps(ar, ar), _mm_mul_ps(ag, ag)),
+              _mm_mul_ps(ab, ab));
+          e = _mm_add_ps(e, _mm_mul_ps(a2, _mm_set1_ps(invSigmaA)));
+        }
+        __m128 arg = _mm_sub_ps(zero, e);
+        __m128 facing = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        if (useNormal) {
+          __m128 d = _mm_add_ps(
+              _mm_add_ps(
+                  _mm_mul_ps(_mm_loadu_ps(nX + p), _mm_loadu_ps(nX + q)),
+                  _mm_mul_ps(_mm_loadu_ps(nY + p), _mm_loadu_ps(nY + q))),
+              _mm_mul_ps(_mm_loadu_ps(nZ + p), _mm_loadu_ps(nZ + q)));
+          facing = _mm_cmpgt_ps(d, zero);
+          __m128 logD = approxLog(_mm_max_ps(d, _mm_set1_ps(minDot)));
+          arg = _mm_add_ps(arg, _mm_mul_ps(_mm_set1_ps(sigmaN), logD));
+        }
+        // dropped lanes still run exp, clamped so it stays normal
+        __m128 keep = _mm_and_ps(facing, _mm_cmpgt_ps(arg, minArgV));
+        __m128 wq = _mm_and_ps(
+            keep, _mm_mul_ps(hv, approxExp(_mm_max_ps(arg, minArgV))));
+        _mm_storeu_ps(accR + x,
+                      _mm_add_ps(_mm_loadu_ps(accR + x), _mm_mul_ps(wq, rq)));
+        _mm_storeu_ps(accG + x,
+                      _mm_add_ps(_mm_loadu_ps(accG + x), _mm_mul_ps(wq, gq)));
+        _mm_storeu_ps(accB + x,
+                      _mm_add_ps(_mm_loadu_ps(accB + x), _mm_mul_ps(wq, bq)));
+        _mm_storeu_ps(accVar + x,
+                      _mm_add_ps(_mm_loadu_ps(accVar + x),
+                                 _mm_mul_ps(_mm_mul_ps(wq, wq),
+                                            _mm_loadu_ps(var + q))));
+        _mm_storeu_ps(weightSum + x,
+                      _mm_add_ps(_mm_loadu_ps(weightSum + x), wq));
+      }
+#endif
+      for (; x < x1; x++) {
+        int p = row + x;
+        int q = p + offset;
+        float lumQ = 0.2126f * r[q] + 0.7152f * g[q] + 0.0722f * b[q];
+        float e = std::fabs(lumP[x] - lumQ) * invSigmaL[x];
+        if (useDepth) {
+          e = e + std::fabs(dep[p] - dep[q]) * invSigmaD;
+        }
+        if (useAlbedo) {
+          float ar = alR[p] - alR[q];
+          float ag = alG[p] - alG[q];
+          float ab = alB[p] - alB[q];
+          e = e + (ar * ar + ag * ag + ab * ab) * invSigmaA;
+        }
+        float arg = 0.0f - e;
+        bool facing = true;
+        if (useNormal) {
+          float d = nX[p] * nX[q] + nY[p] * nY[q] + nZ[p] * nZ[q];
+          facing = d > 0.0f;
+          arg = arg + sigmaN * approxLog(std::max(d, minDot));
+        }
+        float wq = facing && arg > minArg ? h * approxExp(arg) : 0.0f;
+        accR[x] += wq * r[q];
+        accG[x] += wq * g[q];
+        accB[x] += wq * b[q];
+        accVar[x] += wq * wq * var[q];
+        weightSum[x] += wq;
+      }
+    }
+  }
+  for (int x = 0; x < w; x++) {
+    float inv = 1.0f / weightSum[x];
+    this->outRed[row + x] = accR[x] * inv;
+    this->outGreen[row + x] = accG[x] * inv;
+    this->outBlue[row + x] = accB[x] * inv;
+    this->outVariance[row + x] = accVar[x] * inv * inv;
+  }
+}
+
+template <typename T>
+DenoiseStats AtrousDenoiser::denoise(FramebufferT<T> &fb,
+                                     const DenoiseGuides &guides) {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start = Clock::now();
+
+  this->loadPlanes(fb, guides);
+  for (int i = 0; i < this->settings.iterations; i++) {
+    int step = 1 << i;
+    parallelFor(
+        0, this->height,
+        [&](std::size_t y) {
+          this->filterRow(static_cast<int>(y), step, guides);
+        },
+        this->settings.threadCount, 4);
+    this->red.swap(this->outRed);
+    this->green.swap(this->outGreen);
+    this->blue.swap(this->outBlue);
+    this->variance.swap(this->outVariance);
+  }
+  for (std::size_t i = 0; i < fb.pixels.size(); i++) {
+    fb.pixels[i].mean = Vec3T<T>(this->red[i], this->green[i], this->blue[i]);
+  }
+
+  DenoiseStats stats;
+  stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  double megapixels = fb.pixels.size() / 1.0e6;
+  stats.msPerMegapixel = stats.seconds * 1000.0 / megapixels;
+  return stats;
+}
+
+#endif
@@ -0,0 +1,114 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef DIFFERENTIAL_HPP
+#define DIFFERENTIAL_HPP
+
+#include <custom/ray.hpp>
+
+#include <cmath>
+
+// surface parameterization at a hit, filled by the shape on demand
+template <typename T> struct SurfacePartialsT {
+  Vec2T<T> uv;
+  Vec3T<T> dpdu;
+  Vec3T<T> dpdv;
+  Vec3T<T> dndu;
+  Vec3T<T> dndv;
+};
+
+// change of position and uv on the surface over one pixel in x and y
+template <typename T> struct PixelFootprintT {
+  Vec3T<T> dpdx = Vec3T<T>(T(0));
+  Vec3T<T> dpdy = Vec3T<T>(T(0));
+  Vec2T<T> duvdx = Vec2T<T>(T(0));
+  Vec2T<T> duvdy = Vec2T<T>(T(0));
+};
+
+template <typename T>
+bool transferToPlane(Vec3T<T> origin, Vec3T<T> direction, Vec3T<T> point,
+                     Vec3T<T> normal, Vec3T<T> &hit) {
+  // offset ray hitting the tangent plane of the surface at point
+  T denom = glm::dot(normal, direction);
+  if (std::abs(denom) < T(1.0e-8)) {
+    return false;
+  }
+  T t = glm::dot(normal, point - origin) / denom;
+  hit = origin + t * direction;
+  return true;
+}
+
+template <typename T>
+Vec2T<T> solveUvDifferential(const SurfacePartialsT<T> &s, Vec3T<T> dp) {
+  // least squares fit of dp = du dpdu + dv dpdv, the three equations are
+  // over determined and the normal equations are 2x2
+  T a00 = glm::dot(s.dpdu, s.dpdu);
+  T a01 = glm::dot(s.dpdu, s.dpdv);
+  T a11 = glm::dot(s.dpdv, s.dpdv);
+  T det = a00 * a11 - a01 * a01;
+  if (std::abs(det) < T(1.0e-12)) {
+    return Vec2T<T>(T(0));
+  }
+  T b0 = glm::dot(s.dpdu, dp);
+  T b1 = glm::dot(s.dpdv, dp);
+  return Vec2T<T>(a11 * b0 - a01 * b1, a00 * b1 - a01 * b0) / det;
+}
+
+template <typename T>
+PixelFootprintT<T> getPixelFootprint(const RayDifferentialT<T> &ray,
+                                     Vec3T<T> point, Vec3T<T> normal,
+                                     const SurfacePartialsT<T> &s) {
+  // zero footprint when the ray has no differentials or they graze the
+  // surface, the lookup then takes the finest level
+  PixelFootprintT<T> f;
+  Vec3T<T> px, py;
+  if (!ray.hasDifferentials ||
+      !transferToPlane(ray.rxOrigin, ray.rxDirection, point, normal, px) ||
+      !transferToPlane(ray.ryOrigin, ray.ryDirection, point, normal, py)) {
+    return f;
+  }
+  f.dpdx = px - point;
+  f.dpdy = py - point;
+  f.duvdx = solveUvDifferential(s, f.dpdx);
+  f.duvdy = solveUvDifferential(s, f.dpdy);
+  return f;
+}
+
+template <typename T>
+RayDifferentialT<T> reflectDifferential(const RayDifferentialT<T> &ray,
+                                        Vec3T<T> point, Vec3T<T> normal,
+                                        const SurfacePartialsT<T> &s,
+                                        const PixelFootprintT<T> &f,
+                                        Vec3T<T> wi) {
+  /* Ray leaving point in direction wi with the differentials of a mirror
+     reflection (Igehy 1999). The offset rays start at the footprint
+     corners and turn with the change of the normal across it, so curved
+     surfaces widen or narrow the footprint of the next hit.
+   */
+  RayDifferentialT<T> r;
+  r.origin = point;
+  r.direction = wi;
+  r.hasDifferentials = ray.hasDifferentials;
+  if (!r.hasDifferentials) {
+    return r;
+  }
+  Vec3T<T> wo = -ray.direction;
+  Vec3T<T> dndx = s.dndu * f.duvdx.x + s.dndv * f.duvdx.y;
+  Vec3T<T> dndy = s.dndu * f.duvdy.x + s.dndv * f.duvdy.y;
+  Vec3T<T> dwodx = -ray.rxDirection - wo;
+  Vec3T<T> dwody = -ray.ryDirection - wo;
+  T dDNdx = glm::dot(dwodx, normal) + glm::dot(wo, dndx);
+  T dDNdy = glm::dot(dwody, normal) + glm::dot(wo, dndy);
+  T cosTheta = glm::dot(wo, normal);
+  r.rxOrigin = point + f.dpdx;
+  r.ryOrigin = point + f.dpdy;
+  r.rxDirection = wi - dwodx + T(2) * (cosTheta * dndx + dDNdx * normal);
+  r.ryDirection = wi - dwody + T(2) * (cosTheta * dndy + dDNdy * normal);
+  return r;
+}
+
+using SurfacePartials = SurfacePartialsT<float>;
+using PixelFootprint = PixelFootprintT<float>;
+
+#endif
@@ -0,0 +1,184 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef ENVLIGHT_HPP
+#define ENVLIGHT_HPP
+
+#include <custom/aliastable.hpp>
+#include <custom/imagedecode.hpp>
+#include <custom/mappedfile.hpp>
+#include <custom/parallel.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/* Light arriving from every direction, read from an equirectangular hdr
+   image. Column u is the angle phi = atan2(z, x) around the y axis and row
+   v the angle theta = acos(y) from the top, the first row looks up.
+   Directions are sampled proportional to the radiance of the map: the
+   pixels are weighted by luminance times sin(theta), the area they cover
+   on the sphere, and split into a distribution over rows and one over the
+   pixels of each row. Both are alias tables, a sample costs two lookups
+   whatever the size of the map. The row tables are built in parallel.
+   Radiance is constant over a pixel so eval matches the sampling density.
+ */
+class EnvironmentLight {
+public:
+  EnvironmentLight() {}
+
+  // scale multiplies the radiance of the file
+  bool load(const std::string &path, float scale = 1.0f,
+            unsigned int threadCount = 0);
+  // rgb holds rows of 3 floats from the top row down
+  bool build(const float *rgb, int width, int height, float scale = 1.0f,
+             unsigned int threadCount = 0);
+
+  int getWidth() const { return this->width; }
+  int getHeight() const { return this->height; }
+
+  glm::vec3 eval(glm::vec3 direction) const;
+  // solid angle density of sample for direction
+  float getPdf(glm::vec3 direction) const;
+  /* Direction for two uniform numbers, with its radiance and solid angle
+     density. pdf is 0 when the map is black.
+   */
+  glm::vec3 sample(glm::vec2 u, glm::vec3 &direction, float &pdf) const;
+
+private:
+  int width = 0;
+  int height = 0;
+  std::vector<glm::vec3> radiance;
+  AliasTable rows;
+  std::vector<AliasTable> columns;
+
+  void getPixel(glm::vec3 direction, int &x, int &y) const;
+};
+
+inline bool EnvironmentLight::load(const std::string &path, float scale,
+                                   unsigned int threadCount) {
+  MappedFile file;
+  if (!file.open(path)) {
+    return false;
+  }
+  int w, h, channels;
+  float *pixels = decodeImageFloat(file.data(), file.size(), w, h, channels, 3);
+  if (!pixels) {
+    return false;
+  }
+  bool built = this->build(pixels, w, h, scale, threadCount);
+  std::free(pixels);
+  return built;
+}
+
+inline bool EnvironmentLight::build(const float *rgb, int width, int height,
+                                    float scale, unsigned int threadCount) {
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+  this->width = width;
+  this->height = height;
+  this->radiance.resize(static_cast<std::size_t>(width) * height);
+  this->columns.resize(height);
+  std::vector<float> rowWeights(height);
+
+  // rows only write their own pixels, weights and table
+  parallelFor(
+      0, static_cast<std::size_t>(height),
+      [&](std::size_t y) {
+        float theta = glm::pi<float>() * (y + 0.5f) / height;
+        float sinTheta = std::sin(theta);
+        std::vector<float> weights(width);
+        glm::vec3 *row = &this->radiance[y * width];
+        const float *src = rgb + y * width * 3;
+        double sum = 0.0;
+        for (int x = 0; x < width; x++) {
+          row[x] = glm::vec3(src[3 * x], src[3 * x + 1], src[3 * x + 2]) *
+                   scale;
+          float luminance = glm::dot(row[x], glm::vec3(0.2126f, 0.7152f,
+                                                       0.0722f));
+          weights[x] = std::max(luminance, 0.0f) * sinTheta;
+          sum += weights[x];
+        }
+        this->columns[y].build(weights.data(), weights.size());
+        rowWeights[y] = static_cast<float>(sum);
+      },
+      threadCount, 8);
+  this->rows.build(rowWeights.data(), rowWeights.size());
+  return true;
+}
+
+inline void EnvironmentLight::getPixel(glm::vec3 direction, int &x,
+                                       int &y) const {
+  glm::vec3 d = glm::normalize(direction);
+  float phi = std::atan2(d.z, d.x);
+  if (phi < 0.0f) {
+    phi += glm::two_pi<float>();
+  }
+  float theta = std::acos(std::min(std::max(d.y, -1.0f), 1.0f));
+  x = std::min(static_cast<int>(phi * glm::one_over_two_pi<float>() *
+                                this->width),
+               this->width - 1);
+  y = std::min(static_cast<int>(theta * glm::one_over_pi<float>() *
+                                this->height),
+               this->height - 1);
+}
+
+inline glm::vec3 EnvironmentLight::eval(glm::vec3 direction) const {
+  if (this->radiance.empty()) {
+    return glm::vec3(0.0f);
+  }
+  int x, y;
+  this->getPixel(direction, x, y);
+  return this->radiance[static_cast<std::size_t>(y) * this->width + x];
+}
+
+inline float EnvironmentLight::getPdf(glm::vec3 direction) const {
+  if (this->radiance.empty() || this->rows.getTotal() <= 0.0) {
+    return 0.0f;
+  }
+  int x, y;
+  this->getPixel(direction, x, y);
+  float cosTheta = glm::normalize(direction).y;
+  float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+  if (sinTheta <= 0.0f) {
+    return 0.0f;
+  }
+  // density over the unit square of the map, then over the sphere
+  float pdf = this->rows.getPdf(y) * this->columns[y].getPdf(x) *
+              static_cast<float>(this->width) * this->height;
+  return pdf / (2.0f * glm::pi<float>() * glm::pi<float>() * sinTheta);
+}
+
+inline glm::vec3 EnvironmentLight::sample(glm::vec2 u, glm::vec3 &direction,
+                                          float &pdf) const {
+  pdf = 0.0f;
+  if (this->radiance.empty() || this->rows.getTotal() <= 0.0) {
+    direction = glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::vec3(0.0f);
+  }
+  // the bits left over from picking a pixel place the sample inside it
+  float dy, dx;
+  uint32_t y = this->rows.sample(u.x, &dy);
+  uint32_t x = this->columns[y].sample(u.y, &dx);
+  float phi = glm::two_pi<float>() * (x + dx) / this->width;
+  float theta = glm::pi<float>() * (y + dy) / this->height;
+  float sinTheta = std::sin(theta);
+  direction = glm::vec3(sinTheta * std::cos(phi), std::cos(theta),
+                        sinTheta * std::sin(phi));
+  if (sinTheta <= 0.0f) {
+    return glm::vec3(0.0f);
+  }
+  pdf = this->rows.getPdf(y) * this->columns[y].getPdf(x) *
+        static_cast<float>(this->width) * this->height /
+        (2.0f * glm::pi<float>() * glm::pi<float>() * sinTheta);
+  return this->radiance[static_cast<std::size_t>(y) * this->width + x];
+}
+
+#endif
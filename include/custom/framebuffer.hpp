@@ -0,0 +1,115 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <custom/ray.hpp>
+
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+// running statistics of the samples taken for a single pixel
+template <typename T> struct PixelAccumulatorT {
+  Vec3T<T> mean = Vec3T<T>(T(0));
+  // welford state of the luminance, enough to estimate the noise
+  // without keeping the samples around
+  T lumMean = T(0);
+  T lumM2 = T(0);
+  unsigned int sampleCount = 0;
+};
+
+template <typename T> T luminance(Vec3T<T> color) {
+  return T(0.2126) * color.x + T(0.7152) * color.y + T(0.0722) * color.z;
+}
+
+template <typename T> class FramebufferT {
+public:
+  using Scalar = T;
+
+  int width;
+  int height;
+  // row major, row 0 is the bottom of the image
+  std::vector<PixelAccumulatorT<T>> pixels;
+
+  FramebufferT(int w, int h) : width(w), height(h), pixels(w * h) {}
+
+  void addSample(int x, int y, Vec3T<T> color);
+  Vec3T<T> getColor(int x, int y) const;
+  unsigned int getSampleCount(int x, int y) const;
+  T getVariance(int x, int y) const;
+  T getRelativeError(int x, int y) const;
+  void clear();
+};
+
+template <typename T>
+void FramebufferT<T>::addSample(int x, int y, Vec3T<T> color) {
+  PixelAccumulatorT<T> &p = this->pixels[y * this->width + x];
+  p.sampleCount++;
+  T n = static_cast<T>(p.sampleCount);
+  p.mean += (color - p.mean) / n;
+
+  T lum = luminance(color);
+  T delta = lum - p.lumMean;
+  p.lumMean += delta / n;
+  p.lumM2 += delta * (lum - p.lumMean);
+}
+
+template <typename T> Vec3T<T> FramebufferT<T>::getColor(int x, int y) const {
+  return this->pixels[y * this->width + x].mean;
+}
+template <typename T>
+unsigned int FramebufferT<T>::getSampleCount(int x, int y) const {
+  return this->pixels[y * this->width + x].sampleCount;
+}
+
+template <typename T> T FramebufferT<T>::getVariance(int x, int y) const {
+  // unbiased sample variance of the pixel luminance
+  const PixelAccumulatorT<T> &p = this->pixels[y * this->width + x];
+  if (p.sampleCount < 2) {
+    return T(0);
+  }
+  return p.lumM2 / static_cast<T>(p.sampleCount - 1);
+}
+
+template <typename T> T FramebufferT<T>::getRelativeError(int x, int y) const {
+  /* Standard error of the mean luminance relative to the luminance itself.
+     The small offset in the denominator keeps black pixels from being
+     reported as infinitely noisy.
+   */
+  const PixelAccumulatorT<T> &p = this->pixels[y * this->width + x];
+  if (p.sampleCount < 2) {
+    return T(INFINITY);
+  }
+  T stdErr = std::sqrt(this->getVariance(x, y) / p.sampleCount);
+  return stdErr / (p.lumMean + T(1.0e-2));
+}
+
+template <typename T> void FramebufferT<T>::clear() {
+  for (PixelAccumulatorT<T> &p : this->pixels) {
+    p = PixelAccumulatorT<T>();
+  }
+}
+
+template <typename T>
+void writePpm(std::ostream &out, const FramebufferT<T> &fb) {
+  // plain ppm, rows are written top to bottom
+  out << "P3\n" << fb.width << ' ' << fb.height << "\n255\n";
+  for (int j = fb.height - 1; j >= 0; --j) {
+    for (int i = 0; i < fb.width; ++i) {
+      Vec3T<T> c = glm::clamp(fb.getColor(i, j), T(0), T(1));
+      int ir = static_cast<int>(T(255.9) * c.x);
+      int ig = static_cast<int>(T(255.9) * c.y);
+      int ib = static_cast<int>(T(255.9) * c.z);
+      out << ir << ' ' << ig << ' ' << ib << '\n';
+    }
+  }
+  out << std::endl;
+}
+
+using PixelAccumulator = PixelAccumulatorT<float>;
+using Framebuffer = FramebufferT<float>;
+
+#endif
@@ -0,0 +1,134 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef GEOMETRY_HPP
+#define GEOMETRY_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// texture paths are relative to the directory of the model
+struct GeometryMaterial {
+  glm::vec3 diffuseColor = glm::vec3(1.0f);
+  std::string diffusePath;
+  std::string specularPath;
+  std::string normalPath;
+  std::string heightPath;
+};
+
+// firstTangent of meshes without tangent frames
+const unsigned int NO_TANGENTS = ~0u;
+
+// a mesh is a range in the flat vertex and index arrays
+struct GeometryMesh {
+  unsigned int firstVertex;
+  unsigned int vertexCount;
+  unsigned int firstIndex;
+  unsigned int indexCount;
+  // start of the mesh in the tangent streams, vertex i of the mesh has
+  // its frame at firstTangent + i
+  unsigned int firstTangent = NO_TANGENTS;
+  int materialId;
+
+  bool hasTangents() const { return this->firstTangent != NO_TANGENTS; }
+};
+
+/* Read only view of the flat arrays of a model.
+   The arrays belong to a SceneGeometry or to a mapped cache file, code
+   that only reads geometry takes a view and works with both.
+ */
+struct GeometryView {
+  const glm::vec3 *positions = nullptr;
+  const glm::vec3 *normals = nullptr;
+  const glm::vec2 *uvs = nullptr;
+  const glm::vec3 *tangents = nullptr;
+  const glm::vec3 *bitangents = nullptr;
+  const unsigned int *indices = nullptr;
+  const int *triangleMaterials = nullptr;
+  const GeometryMesh *meshes = nullptr;
+  std::size_t vertexCount = 0;
+  std::size_t tangentCount = 0;
+  std::size_t indexCount = 0;
+  std::size_t meshCount = 0;
+
+  std::size_t getTriangleCount() const { return this->indexCount / 3; }
+  void getTriangle(std::size_t triangle, glm::vec3 &a, glm::vec3 &b,
+                   glm::vec3 &c) const {
+    const unsigned int *tri = &this->indices[3 * triangle];
+    a = this->positions[tri[0]];
+    b = this->positions[tri[1]];
+    c = this->positions[tri[2]];
+  }
+};
+
+/* Flat triangle soup of a whole model.
+   Indices are global, three per triangle, so a bvh builder can read
+   triangle i straight from indices[3 * i] without knowing about meshes.
+   Vertex attributes live in separate streams: intersection only touches
+   the tightly packed positions, shading reads the other streams for the
+   few hits it resolves. Tangent frames are stored only for meshes whose
+   material has a normal map.
+ */
+struct SceneGeometry {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> tangents;
+  std::vector<glm::vec3> bitangents;
+  std::vector<unsigned int> indices;
+  // material of every triangle
+  std::vector<int> triangleMaterials;
+  std::vector<GeometryMesh> meshes;
+  std::vector<GeometryMaterial> materials;
+
+  std::size_t getVertexCount() const { return this->positions.size(); }
+  std::size_t getTriangleCount() const { return this->indices.size() / 3; }
+  // bytes of the arrays, material paths not included
+  std::size_t getMemorySize() const;
+  GeometryView getView() const;
+  void getTriangle(std::size_t triangle, glm::vec3 &a, glm::vec3 &b,
+                   glm::vec3 &c) const;
+};
+
+inline void SceneGeometry::getTriangle(std::size_t triangle, glm::vec3 &a,
+                                       glm::vec3 &b, glm::vec3 &c) const {
+  const unsigned int *tri = &this->indices[3 * triangle];
+  a = this->positions[tri[0]];
+  b = this->positions[tri[1]];
+  c = this->positions[tri[2]];
+}
+
+inline std::size_t SceneGeometry::getMemorySize() const {
+  return this->positions.size() * sizeof(glm::vec3) +
+         this->normals.size() * sizeof(glm::vec3) +
+         this->uvs.size() * sizeof(glm::vec2) +
+         this->tangents.size() * sizeof(glm::vec3) +
+         this->bitangents.size() * sizeof(glm::vec3) +
+         this->indices.size() * sizeof(unsigned int) +
+         this->triangleMaterials.size() * sizeof(int) +
+         this->meshes.size() * sizeof(GeometryMesh) +
+         this->materials.size() * sizeof(GeometryMaterial);
+}
+
+inline GeometryView SceneGeometry::getView() const {
+  GeometryView view;
+  view.positions = this->positions.data();
+  view.normals = this->normals.data();
+  view.uvs = this->uvs.data();
+  view.tangents = this->tangents.data();
+  view.bitangents = this->bitangents.data();
+  view.indices = this->indices.data();
+  view.triangleMaterials = this->triangleMaterials.data();
+  view.meshes = this->meshes.data();
+  view.vertexCount = this->positions.size();
+  view.tangentCount = this->tangents.size();
+  view.indexCount = this->indices.size();
+  view.meshCount = this->meshes.size();
+  return view;
+}
+
+#endif
@@ -0,0 +1,233 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef IMAGEARENA_HPP
+#define IMAGEARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/* Bump allocator for the scratch memory of an image decode.
+   stb image makes many short lived allocations per file and grows its
+   zlib buffers with realloc. With bulk loads on every core those calls
+   all contend on the global allocator. Each thread has its own arena
+   instead: a decode runs inside a Scope, its allocations are carved out
+   of the arena chunks, and the whole arena is reset when the scope ends.
+   Memory handed out by a scope is gone after it, the caller copies out
+   whatever it keeps. Outside a scope the hooks fall back to malloc.
+ */
+class ImageArena {
+public:
+  explicit ImageArena(std::size_t chunkSize = std::size_t(4) << 20)
+      : chunkSize(chunkSize) {}
+  ~ImageArena();
+  ImageArena(const ImageArena &) = delete;
+  ImageArena &operator=(const ImageArena &) = delete;
+
+  void *allocate(std::size_t size);
+  void *reallocate(void *p, std::size_t size);
+  // only the newest allocation of a chunk gives its bytes back
+  void release(void *p);
+  bool owns(const void *p) const;
+  // drops every allocation, the chunks are kept for the next decode
+  void reset();
+  std::size_t getCapacity() const;
+
+  // arena of the calling thread, null outside a Scope
+  static ImageArena *getActive();
+
+  struct Scope {
+    Scope();
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+private:
+  struct Chunk {
+    unsigned char *data;
+    std::size_t size;
+    std::size_t used;
+  };
+  // every allocation is preceded by its size, padded to keep alignment
+  static constexpr std::size_t HEADER = 16;
+  // bytes kept between decodes, the rest goes back to the system
+  static constexpr std::size_t RETAIN = std::size_t(64) << 20;
+
+  std::size_t chunkSize;
+  std::vector<Chunk> chunks;
+
+  static ImageArena *&activeSlot();
+  static ImageArena &getThreadArena();
+  static std::size_t getBlockSize(const void *p);
+  Chunk *findChunk(const void *p);
+  const Chunk *findChunk(const void *p) const;
+};
+
+inline ImageArena::~ImageArena() {
+  for (Chunk &c : this->chunks) {
+    std::free(c.data);
+  }
+}
+
+inline ImageArena *&ImageArena::activeSlot() {
+  static thread_local ImageArena *active = nullptr;
+  return active;
+}
+
+inline ImageArena &ImageArena::getThreadArena() {
+  static thread_local ImageArena arena;
+  return arena;
+}
+
+inline ImageArena *ImageArena::getActive() { return activeSlot(); }
+
+inline ImageArena::Scope::Scope() {
+  activeSlot() = &getThreadArena();
+}
+
+inline ImageArena::Scope::~Scope() {
+  getThreadArena().reset();
+  activeSlot() = nullptr;
+}
+
+inline std::size_t ImageArena::getBlockSize(const void *p) {
+  std::size_t size;
+  std::memcpy(&size, static_cast<const unsigned char *>(p) - HEADER,
+              sizeof(size));
+  return size;
+}
+
+inline void *ImageArena::allocate(std::size_t size) {
+  std::size_t block = HEADER + (size + HEADER - 1) / HEADER * HEADER;
+  if (this->chunks.empty() ||
+      this->chunks.back().size - this->chunks.back().used < block) {
+    Chunk c;
+    c.size = std::max(this->chunkSize, block);
+    c.data = static_cast<unsigned char *>(std::malloc(c.size));
+    c.used = 0;
+    if (!c.data) {
+      return nullptr;
+    }
+    this->chunks.push_back(c);
+  }
+  Chunk &c = this->chunks.back();
+  unsigned char *p = c.data + c.used + HEADER;
+  std::size_t stored = block - HEADER;
+  std::memcpy(p - HEADER, &stored, sizeof(stored));
+  c.used += block;
+  return p;
+}
+
+inline void *ImageArena::reallocate(void *p, std::size_t size) {
+  if (!p) {
+    return this->allocate(size);
+  }
+  Chunk *c = this->findChunk(p);
+  if (!c) {
+    return std::realloc(p, size);
+  }
+  std::size_t old = getBlockSize(p);
+  unsigned char *bytes = static_cast<unsigned char *>(p);
+  bool newest = bytes + old == c->data + c->used;
+  std::size_t grown = (size + HEADER - 1) / HEADER * HEADER;
+  if (newest && bytes - c->data + grown <= c->size) {
+    // growing the newest block is free, zlib output buffers do this
+    c->used = static_cast<std::size_t>(bytes - c->data) + grown;
+    std::memcpy(bytes - HEADER, &grown, sizeof(grown));
+    return p;
+  }
+  void *moved = this->allocate(size);
+  if (moved) {
+    std::memcpy(moved, p, std::min(old, size));
+    this->release(p);
+  }
+  return moved;
+}
+
+inline void ImageArena::release(void *p) {
+  if (!p) {
+    return;
+  }
+  Chunk *c = this->findChunk(p);
+  if (!c) {
+    std::free(p);
+    return;
+  }
+  unsigned char *bytes = static_cast<unsigned char *>(p);
+  if (bytes + getBlockSize(p) == c->data + c->used) {
+    c->used = static_cast<std::size_t>(bytes - HEADER - c->data);
+  }
+}
+
+inline ImageArena::Chunk *ImageArena::findChunk(const void *p) {
+  const ImageArena *self = this;
+  return const_cast<Chunk *>(self->findChunk(p));
+}
+
+inline const ImageArena::Chunk *ImageArena::findChunk(const void *p) const {
+  const unsigned char *bytes = static_cast<const unsigned char *>(p);
+  for (const Chunk &c : this->chunks) {
+    if (bytes >= c.data && bytes < c.data + c.size) {
+      return &c;
+    }
+  }
+  return nullptr;
+}
+
+inline bool ImageArena::owns(const void *p) const {
+  return this->findChunk(p) != nullptr;
+}
+
+inline void ImageArena::reset() {
+  // a decode that needed several chunks gets one chunk that fits it all
+  // next time, as long as it stays under the retained size
+  if (this->chunks.size() > 1) {
+    std::size_t total = this->getCapacity();
+    for (Chunk &c : this->chunks) {
+      std::free(c.data);
+    }
+    this->chunks.clear();
+    this->chunkSize = std::min(std::max(this->chunkSize, total), RETAIN);
+  } else if (!this->chunks.empty() && this->chunks[0].size > RETAIN) {
+    std::free(this->chunks[0].data);
+    this->chunks.clear();
+  }
+  for (Chunk &c : this->chunks) {
+    c.used = 0;
+  }
+}
+
+inline std::size_t ImageArena::getCapacity() const {
+  std::size_t total = 0;
+  for (const Chunk &c : this->chunks) {
+    total += c.size;
+  }
+  return total;
+}
+
+// allocation hooks for stb image, see imagedecode.hpp
+inline void *imageArenaMalloc(std::size_t size) {
+  ImageArena *arena = ImageArena::getActive();
+  return arena ? arena->allocate(size) : std::malloc(size);
+}
+
+inline void *imageArenaRealloc(void *p, std::size_t size) {
+  ImageArena *arena = ImageArena::getActive();
+  return arena ? arena->reallocate(p, size) : std::realloc(p, size);
+}
+
+inline void imageArenaFree(void *p) {
+  ImageArena *arena = ImageArena::getActive();
+  if (arena) {
+    arena->release(p);
+  } else {
+    std::free(p);
+  }
+}
+
+#endif
@@ -0,0 +1,78 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef IMAGEDECODE_HPP
+#define IMAGEDECODE_HPP
+
+// stb image allocates from the decode arena of its thread. Its functions
+// are static, so every translation unit including this gets its own copy
+// and programs of several units link
+#include <custom/imagearena.hpp>
+#define STBI_MALLOC(size) imageArenaMalloc(size)
+#define STBI_REALLOC(p, size) imageArenaRealloc(p, size)
+#define STBI_FREE(p) imageArenaFree(p)
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#if defined(__GNUC__)
+// a unit only calls the few entry points it needs
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include <custom/stb_image.h>
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+inline unsigned char *decodeImage(const unsigned char *bytes, std::size_t size,
+                                  int &width, int &height, int &nrComponents,
+                                  int desiredComponents = 0) {
+  /* Decode an image file held in memory, null on failure.
+     Scratch memory of the decode is dropped at the end of the arena
+     scope, only the final pixels are copied out into a malloc block that
+     the caller releases with free. nrComponents is the channel count of
+     the file, the pixels have desiredComponents channels when it is not 0.
+   */
+  ImageArena::Scope arena;
+  unsigned char *data =
+      stbi_load_from_memory(bytes, static_cast<int>(size), &width, &height,
+                            &nrComponents, desiredComponents);
+  if (!data) {
+    return nullptr;
+  }
+  int channels = desiredComponents != 0 ? desiredComponents : nrComponents;
+  std::size_t pixelBytes =
+      static_cast<std::size_t>(width) * height * channels;
+  unsigned char *pixels = static_cast<unsigned char *>(std::malloc(pixelBytes));
+  if (pixels) {
+    std::memcpy(pixels, data, pixelBytes);
+  }
+  return pixels;
+}
+
+inline float *decodeImageFloat(const unsigned char *bytes, std::size_t size,
+                               int &width, int &height, int &nrComponents,
+                               int desiredComponents = 0) {
+  // same as decodeImage for hdr files, linear float channels
+  ImageArena::Scope arena;
+  float *data =
+      stbi_loadf_from_memory(bytes, static_cast<int>(size), &width, &height,
+                             &nrComponents, desiredComponents);
+  if (!data) {
+    return nullptr;
+  }
+  int channels = desiredComponents != 0 ? desiredComponents : nrComponents;
+  std::size_t pixelBytes =
+      static_cast<std::size_t>(width) * height * channels * sizeof(float);
+  float *pixels = static_cast<float *>(std::malloc(pixelBytes));
+  if (pixels) {
+    std::memcpy(pixels, data, pixelBytes);
+  }
+  return pixels;
+}
+
+#endif
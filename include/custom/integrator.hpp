@@ -0,0 +1,362 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef INTEGRATOR_HPP
+#define INTEGRATOR_HPP
+
+#include <custom/aov.hpp>
+#include <custom/sampler.hpp>
+#include <custom/scene.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+// features a scene may use, every combination is its own integrator type
+template <bool HasMaterials, bool HasDirectionalLights, bool HasPointLights,
+          bool HasEnvironment, LightSelection Selection, unsigned int AovMask,
+          typename T>
+struct IntegratorFeatures {
+  static constexpr bool materials = HasMaterials;
+  static constexpr bool directionalLights = HasDirectionalLights;
+  static constexpr bool pointLights = HasPointLights;
+  static constexpr bool environment = HasEnvironment;
+  static constexpr LightSelection lightSelection = Selection;
+  static constexpr unsigned int aovMask = AovMask;
+  using Scalar = T;
+  // beauty only renders return a bare color
+  using Sample = typename std::conditional<AovMask == AOV_NONE, Vec3T<T>,
+                                           AovSampleT<T>>::type;
+};
+
+template <typename T> std::vector<T> &getLightScratch(int slot) {
+  // per thread buffers of the light loops, they only grow
+  static thread_local std::vector<T> buffers[2];
+  return buffers[slot];
+}
+
+// albedo of every surface when the scene has no materials
+const float DEFAULT_ALBEDO = 0.5f;
+const float SHADOW_EPSILON = 1.0e-3f;
+
+/* Diffuse path tracer specialized on a feature set.
+   Every feature test is an if constexpr, so an instantiation only contains
+   the code its scene needs and the per sample path has no virtual calls
+   and no runtime feature branches. Pick the instantiation once with
+   dispatchIntegrator.
+ */
+template <typename Features> class Integrator {
+public:
+  using T = typename Features::Scalar;
+  using Scalar = T;
+  using Sample = typename Features::Sample;
+  static constexpr unsigned int aovMask = Features::aovMask;
+
+  const Scene &scene;
+  int maxDepth;
+
+  Integrator(const Scene &s, int depth = 4);
+  Sample sample(RayT<T> ray, Rng &rng) const;
+  // differentials of a camera ray pick the mip level of textures
+  Sample sample(RayDifferentialT<T> ray, Rng &rng) const;
+
+private:
+  // geometry converted once to the precision of the integrator, the
+  // arrays are what the rays are tested against
+  std::vector<SphereT<T>> spheres;
+  SphereArrayT<T> sphereArray;
+  // differentials are only carried along when a material reads a texture
+  bool textured = false;
+
+  bool intersect(const RayT<T> &ray, T tmax, HitRecordT<T> &rec) const;
+  bool occluded(const RayT<T> &ray, T tmax) const;
+  Vec3T<T> directLight(Vec3T<T> point, Vec3T<T> normal, Rng &rng) const;
+  Vec3T<T> sky(Vec3T<T> direction) const;
+};
+
+template <typename Features>
+Integrator<Features>::Integrator(const Scene &s, int depth)
+    : scene(s), maxDepth(depth) {
+  this->spheres.reserve(s.spheres.size());
+  for (const Sphere &sphere : s.spheres) {
+    SphereT<T> converted;
+    converted.center = Vec3T<T>(sphere.center);
+    converted.radius = static_cast<T>(sphere.radius);
+    this->spheres.push_back(converted);
+    this->sphereArray.push_back(converted);
+  }
+  if constexpr (Features::materials) {
+    for (const Material &m : s.materials) {
+      this->textured = this->textured || m.albedoTexture >= 0;
+    }
+  }
+}
+
+template <typename Features>
+bool Integrator<Features>::intersect(const RayT<T> &ray, T tmax,
+                                     HitRecordT<T> &rec) const {
+  T t;
+  int i = this->sphereArray.hitClosest(ray, T(SHADOW_EPSILON), tmax, t);
+  if (i < 0) {
+    return false;
+  }
+  this->spheres[i].setHit(ray, t, rec);
+  rec.instanceId = i;
+  return true;
+}
+
+template <typename Features>
+bool Integrator<Features>::occluded(const RayT<T> &ray, T tmax) const {
+  return this->sphereArray.hitAny(ray, T(SHADOW_EPSILON), tmax);
+}
+
+template <typename Features>
+Vec3T<typename Features::Scalar>
+Integrator<Features>::directLight(Vec3T<T> point, Vec3T<T> normal,
+                                  Rng &rng) const {
+  // irradiance from the analytic lights, with shadow rays
+  Vec3T<T> irradiance(T(0));
+  if constexpr (Features::environment) {
+    // one direction drawn from the map, weighted against the chance of
+    // the cosine bounce finding it with the power heuristic
+    glm::vec2 u(rng.next(), rng.next());
+    glm::vec3 dir;
+    float lightPdf;
+    glm::vec3 l = this->scene.environment->sample(u, dir, lightPdf);
+    Vec3T<T> toLight(dir);
+    T cosTheta = glm::dot(normal, toLight);
+    if (lightPdf > 0.0f && cosTheta > T(0) &&
+        !this->occluded(RayT<T>{point, toLight}, T(INFINITY))) {
+      T pdf = static_cast<T>(lightPdf);
+      T bsdfPdf = cosTheta * glm::one_over_pi<T>();
+      T weight = pdf * pdf / (pdf * pdf + bsdfPdf * bsdfPdf);
+      irradiance += Vec3T<T>(l) * cosTheta * weight / pdf;
+    }
+  }
+  // the unshadowed terms of a whole array are computed in one vectorized
+  // loop, shadow rays are only traced for lights that add something
+  std::vector<T> &scales = getLightScratch<T>(0);
+  std::vector<T> &distances = getLightScratch<T>(1);
+  if constexpr (Features::directionalLights) {
+    const DirectionalLightArray &lights = this->scene.directionalLights;
+    scales.resize(lights.size());
+    lights.getCosines(normal, scales.data());
+    const glm::vec3 *colors = lights.getColors();
+    for (std::size_t i = 0; i < lights.size(); i++) {
+      if (scales[i] > T(0) &&
+          !this->occluded(RayT<T>{point, Vec3T<T>(lights.getToLight(i))},
+                          T(INFINITY))) {
+        irradiance += Vec3T<T>(colors[i]) * scales[i];
+      }
+    }
+  }
+  if constexpr (Features::pointLights &&
+                Features::lightSelection != LIGHTS_ALL) {
+    // one light picked by its estimated contribution or by its power,
+    // divided by the chance of picking it
+    const PointLightArray &lights = this->scene.pointLights;
+    uint32_t i;
+    float pmf = 0.0f;
+    if constexpr (Features::lightSelection == LIGHTS_BVH) {
+      if (!this->scene.lightBvh.sample(glm::vec3(point), glm::vec3(normal),
+                                       rng.next(), i, pmf)) {
+        pmf = 0.0f;
+      }
+    } else {
+      i = this->scene.lightPowers.sample(rng.next(), &pmf);
+    }
+    if (pmf > 0.0f) {
+      Vec3T<T> toLight = Vec3T<T>(lights.getPosition(i)) - point;
+      T distance = glm::length(toLight);
+      toLight /= distance;
+      T cosTheta = glm::dot(normal, toLight);
+      if (cosTheta > T(0) &&
+          !this->occluded(RayT<T>{point, toLight}, distance)) {
+        T attenuation = static_cast<T>(
+            lights.getAttenuation(i, static_cast<float>(distance)));
+        irradiance += Vec3T<T>(lights.getColor(i)) * cosTheta * attenuation /
+                      static_cast<T>(pmf);
+      }
+    }
+  } else if constexpr (Features::pointLights) {
+    const PointLightArray &lights = this->scene.pointLights;
+    scales.resize(lights.size());
+    distances.resize(lights.size());
+    lights.getIrradianceScales(point, normal, scales.data(), distances.data());
+    const glm::vec3 *colors = lights.getColors();
+    for (std::size_t i = 0; i < lights.size(); i++) {
+      if (scales[i] > T(0)) {
+        Vec3T<T> toLight =
+            (Vec3T<T>(lights.getPosition(i)) - point) / distances[i];
+        if (!this->occluded(RayT<T>{point, toLight}, distances[i])) {
+          irradiance += Vec3T<T>(colors[i]) * scales[i];
+        }
+      }
+    }
+  }
+  return irradiance;
+}
+
+template <typename Features>
+Vec3T<typename Features::Scalar>
+Integrator<Features>::sky(Vec3T<T> direction) const {
+  if constexpr (Features::environment) {
+    return Vec3T<T>(this->scene.environment->eval(glm::vec3(direction)));
+  }
+  T t = T(0.5) * (glm::normalize(direction).y + T(1));
+  return (T(1) - t) * Vec3T<T>(this->scene.skyBottom) +
+         t * Vec3T<T>(this->scene.skyTop);
+}
+
+template <typename Features>
+typename Integrator<Features>::Sample
+Integrator<Features>::sample(RayT<T> ray, Rng &rng) const {
+  RayDifferentialT<T> r;
+  r.origin = ray.origin;
+  r.direction = ray.direction;
+  return this->sample(r, rng);
+}
+
+template <typename Features>
+typename Integrator<Features>::Sample
+Integrator<Features>::sample(RayDifferentialT<T> ray, Rng &rng) const {
+  AovSampleT<T> result;
+  ray.hasDifferentials = ray.hasDifferentials && this->textured;
+  // density of the last bounce direction, for the weight of the map
+  T bouncePdf = T(0);
+  Vec3T<T> throughput(T(1));
+  Vec3T<T> radiance(T(0));
+
+  for (int depth = 0; depth < this->maxDepth; depth++) {
+    HitRecordT<T> rec;
+    if (!this->intersect(ray, T(INFINITY), rec)) {
+      T weight = T(1);
+      if constexpr (Features::environment) {
+        if (depth > 0) {
+          T lightPdf = static_cast<T>(
+              this->scene.environment->getPdf(glm::vec3(ray.direction)));
+          weight = bouncePdf * bouncePdf /
+                   (bouncePdf * bouncePdf + lightPdf * lightPdf);
+        }
+      }
+      radiance += throughput * this->sky(ray.direction) * weight;
+      if constexpr (aovEnabled(Features::aovMask, AOV_ALBEDO)) {
+        if (depth == 0) {
+          result.albedo = this->sky(ray.direction);
+        }
+      }
+      break;
+    }
+    Vec3T<T> albedo(static_cast<T>(DEFAULT_ALBEDO));
+    SurfacePartialsT<T> partials;
+    PixelFootprintT<T> footprint;
+    if (ray.hasDifferentials) {
+      partials = this->spheres[rec.instanceId].getPartials(rec.normal);
+      footprint = getPixelFootprint(ray, rec.point, rec.normal, partials);
+    }
+    if constexpr (Features::materials) {
+      int materialId = this->scene.materialIds[rec.instanceId];
+      const Material &material = this->scene.materials[materialId];
+      albedo = Vec3T<T>(material.albedo);
+      if (material.albedoTexture >= 0) {
+        if (!ray.hasDifferentials) {
+          partials = this->spheres[rec.instanceId].getPartials(rec.normal);
+        }
+        glm::vec4 texel =
+            this->scene.textures[material.albedoTexture].sampleDifferential(
+                glm::vec2(partials.uv), glm::vec2(footprint.duvdx),
+                glm::vec2(footprint.duvdy));
+        albedo *= Vec3T<T>(glm::vec3(texel));
+      }
+    }
+    if constexpr (Features::aovMask != AOV_NONE) {
+      if (depth == 0) {
+        result.depth = rec.t;
+        result.normal = rec.normal;
+        result.albedo = albedo;
+        result.instanceId = rec.instanceId;
+      }
+    }
+    if constexpr (Features::directionalLights || Features::pointLights ||
+                  Features::environment) {
+      // lambertian brdf is albedo / pi
+      radiance += throughput * albedo *
+                  this->directLight(rec.point, rec.normal, rng) *
+                  glm::one_over_pi<T>();
+    }
+
+    // cosine weighted bounce, the pdf cancels the cosine and the pi
+    T z = static_cast<T>(rng.next()) * T(2) - T(1);
+    T phi = static_cast<T>(rng.next()) * glm::two_pi<T>();
+    T r = std::sqrt(T(1) - z * z);
+    Vec3T<T> onSphere(r * std::cos(phi), r * std::sin(phi), z);
+    Vec3T<T> bounce = rec.normal + onSphere;
+    if (glm::dot(bounce, bounce) < T(1.0e-8)) {
+      bounce = rec.normal;
+    }
+    // the mirror transfer of the differentials stands in for the diffuse
+    // lobe, it keeps the spread of the footprint and the curvature of the
+    // surface but not the widening from the lobe itself
+    ray = reflectDifferential(ray, rec.point, rec.normal, partials, footprint,
+                              Vec3T<T>(glm::normalize(bounce)));
+    bouncePdf = std::max(glm::dot(rec.normal, ray.direction), T(0)) *
+                glm::one_over_pi<T>();
+    throughput *= albedo;
+  }
+
+  if constexpr (Features::aovMask == AOV_NONE) {
+    return radiance;
+  } else {
+    result.color = radiance;
+    return result;
+  }
+}
+
+template <unsigned int AovMask, typename T, LightSelection S, bool M, bool D,
+          bool P, bool E, typename Function>
+void dispatchFeatures(const Scene &scene, Function &fn) {
+  using F = IntegratorFeatures<M, D, P, E, S, AovMask, T>;
+  fn(Integrator<F>(scene));
+}
+
+template <unsigned int AovMask, typename T, LightSelection S, bool... Bound,
+          typename Function>
+void dispatchFlags(const Scene &scene, Function &fn, const bool *flags) {
+  // turns the runtime flags into template arguments one at a time
+  if constexpr (sizeof...(Bound) == 4) {
+    dispatchFeatures<AovMask, T, S, Bound...>(scene, fn);
+  } else if (flags[sizeof...(Bound)]) {
+    dispatchFlags<AovMask, T, S, Bound..., true>(scene, fn, flags);
+  } else {
+    dispatchFlags<AovMask, T, S, Bound..., false>(scene, fn, flags);
+  }
+}
+
+template <unsigned int AovMask, typename T = float, typename Function>
+void dispatchIntegrator(const Scene &scene, Function fn) {
+  /* Look at the scene once and call fn with the integrator specialized on
+     what the scene contains. fn is usually a generic lambda, so the whole
+     render loop inside it is instantiated per feature set.
+   */
+  const bool flags[4] = {!scene.materials.empty(),
+                         !scene.directionalLights.empty(),
+                         !scene.pointLights.empty(),
+                         scene.environment != nullptr};
+  switch (scene.getLightSelection()) {
+  case LIGHTS_ALL:
+    dispatchFlags<AovMask, T, LIGHTS_ALL>(scene, fn, flags);
+    break;
+  case LIGHTS_BVH:
+    dispatchFlags<AovMask, T, LIGHTS_BVH>(scene, fn, flags);
+    break;
+  case LIGHTS_POWER:
+    dispatchFlags<AovMask, T, LIGHTS_POWER>(scene, fn, flags);
+    break;
+  }
+}
+
+#endif
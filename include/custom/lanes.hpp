@@ -0,0 +1,67 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef LANES_HPP
+#define LANES_HPP
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* The few sse2 operations the templated core runs on packs of its scalar:
+   four floats or two doubles per register. Code written against LanesT<T>
+   therefore does twice the work per instruction in float. width is 1 and
+   the specialization is absent without sse2, callers keep a scalar loop
+   for that case and for the tail.
+ */
+template <typename T> struct LanesT {
+  static constexpr int width = 1;
+};
+
+#if defined(__SSE2__)
+template <> struct LanesT<float> {
+  static constexpr int width = 4;
+  using V = __m128;
+  static V load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+  static V set(float x) { return _mm_set1_ps(x); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V div(V a, V b) { return _mm_div_ps(a, b); }
+  static V sqrt(V a) { return _mm_sqrt_ps(a); }
+  static V lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static V gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+  static V ge(V a, V b) { return _mm_cmpge_ps(a, b); }
+  static V andMask(V a, V b) { return _mm_and_ps(a, b); }
+  // mask ? a : b
+  static V select(V mask, V a, V b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+  static int bits(V mask) { return _mm_movemask_ps(mask); }
+};
+
+template <> struct LanesT<double> {
+  static constexpr int width = 2;
+  using V = __m128d;
+  static V load(const double *p) { return _mm_loadu_pd(p); }
+  static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+  static V set(double x) { return _mm_set1_pd(x); }
+  static V add(V a, V b) { return _mm_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm_div_pd(a, b); }
+  static V sqrt(V a) { return _mm_sqrt_pd(a); }
+  static V lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+  static V gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+  static V ge(V a, V b) { return _mm_cmpge_pd(a, b); }
+  static V andMask(V a, V b) { return _mm_and_pd(a, b); }
+  static V select(V mask, V a, V b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+  }
+  static int bits(V mask) { return _mm_movemask_pd(mask); }
+};
+#endif
+
+#endif
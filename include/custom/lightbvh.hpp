@@ -0,0 +1,293 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef LIGHTBVH_HPP
+#define LIGHTBVH_HPP
+
+#include <custom/light.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Hierarchy over the point lights of a scene for picking one light per
+   shading point in proportion to its likely contribution.
+   Every node bounds the positions of its lights and keeps their total
+   power and the smallest attenuation coefficients among them. At a
+   shading point a node is worth its power times the attenuation at the
+   nearest distance its bounds allow times the largest cosine toward
+   them. A sample walks from the root choosing a child in proportion to
+   that estimate, O(log N) for N lights, and returns the probability of
+   the path. At a leaf the estimate is the unshadowed contribution of the
+   light itself.
+ */
+class LightBvh {
+public:
+  LightBvh() {}
+
+  void build(const PointLightArray &lights);
+  bool empty() const { return this->nodes.empty(); }
+  // number of lights the hierarchy was built over
+  std::size_t getLightCount() const { return this->leaves.size(); }
+  int getDepth() const { return this->depth; }
+
+  /* Pick a light for u in [0, 1). False when no light can reach the
+     point, light and pmf are left unset then.
+   */
+  bool sample(glm::vec3 point, glm::vec3 normal, float u, uint32_t &light,
+              float &pmf) const;
+  // probability of sample returning light at this point
+  float getPmf(glm::vec3 point, glm::vec3 normal, uint32_t light) const;
+  // new power for one light, refits the nodes above it in O(log N)
+  void setPower(uint32_t light, float power);
+  /* New position for one light, refits the bounds above it in O(log N).
+     The tree keeps its shape, so lights moved far from their neighbours
+     loosen the bounds; sampling stays exact but a new build samples
+     better.
+   */
+  void setPosition(uint32_t light, glm::vec3 position);
+
+private:
+  struct Node {
+    glm::vec3 lo;
+    glm::vec3 hi;
+    float power;
+    float attenuationConstant;
+    float attenuationLinear;
+    float attenuationQuadratic;
+    // interior nodes: second child, the first one follows the node
+    // leaves: index of the light
+    uint32_t index;
+    uint32_t parent;
+    bool leaf;
+  };
+  std::vector<Node> nodes;
+  // leaf node of every light
+  std::vector<uint32_t> leaves;
+  int depth = 0;
+
+  uint32_t buildRange(const PointLightArray &lights, uint32_t *order,
+                      uint32_t count, uint32_t parent, int level);
+  float getImportance(const Node &node, glm::vec3 point,
+                      glm::vec3 normal) const;
+  // recomputes the nodes above a leaf from their children
+  void refitAbove(uint32_t leaf);
+};
+
+inline float getLightPower(glm::vec3 color) {
+  // luminance of the color
+  return std::max(glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f)),
+                  0.0f);
+}
+
+inline void LightBvh::build(const PointLightArray &lights) {
+  this->nodes.clear();
+  this->leaves.assign(lights.size(), 0);
+  this->depth = 0;
+  if (lights.empty()) {
+    return;
+  }
+  std::vector<uint32_t> order(lights.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = static_cast<uint32_t>(i);
+  }
+  this->nodes.reserve(2 * lights.size() - 1);
+  this->buildRange(lights, order.data(), static_cast<uint32_t>(order.size()),
+                   ~0u, 1);
+}
+
+inline uint32_t LightBvh::buildRange(const PointLightArray &lights,
+                                     uint32_t *order, uint32_t count,
+                                     uint32_t parent, int level) {
+  this->depth = std::max(this->depth, level);
+  uint32_t index = static_cast<uint32_t>(this->nodes.size());
+  this->nodes.emplace_back();
+  if (count == 1) {
+    uint32_t l = order[0];
+    PointLight light = lights.get(l);
+    Node &node = this->nodes[index];
+    node.lo = node.hi = light.position;
+    node.power = getLightPower(light.getColor());
+    node.attenuationConstant = light.attenuationConstant;
+    node.attenuationLinear = light.attenuationLinear;
+    node.attenuationQuadratic = light.attenuationQuadratic;
+    node.index = l;
+    node.parent = parent;
+    node.leaf = true;
+    this->leaves[l] = index;
+    return index;
+  }
+
+  // median split on the longest axis of the light positions
+  glm::vec3 lo(INFINITY), hi(-INFINITY);
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 p = lights.getPosition(order[i]);
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  glm::vec3 extent = hi - lo;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                 : (extent.y > extent.z ? 1 : 2);
+  uint32_t half = count / 2;
+  std::nth_element(order, order + half, order + count,
+                   [&](uint32_t a, uint32_t b) {
+                     return lights.getPosition(a)[axis] <
+                            lights.getPosition(b)[axis];
+                   });
+  this->buildRange(lights, order, half, index, level + 1);
+  uint32_t second =
+      this->buildRange(lights, order + half, count - half, index, level + 1);
+
+  // the vector may have grown, the node is only written now
+  const Node &a = this->nodes[index + 1];
+  const Node &b = this->nodes[second];
+  Node &node = this->nodes[index];
+  node.lo = glm::min(a.lo, b.lo);
+  node.hi = glm::max(a.hi, b.hi);
+  node.power = a.power + b.power;
+  node.attenuationConstant =
+      std::min(a.attenuationConstant, b.attenuationConstant);
+  node.attenuationLinear = std::min(a.attenuationLinear, b.attenuationLinear);
+  node.attenuationQuadratic =
+      std::min(a.attenuationQuadratic, b.attenuationQuadratic);
+  node.index = second;
+  node.parent = parent;
+  node.leaf = false;
+  return index;
+}
+
+inline void LightBvh::setPower(uint32_t light, float power) {
+  if (light >= this->leaves.size()) {
+    return;
+  }
+  this->nodes[this->leaves[light]].power = power;
+  this->refitAbove(this->leaves[light]);
+}
+
+inline void LightBvh::setPosition(uint32_t light, glm::vec3 position) {
+  if (light >= this->leaves.size()) {
+    return;
+  }
+  Node &leaf = this->nodes[this->leaves[light]];
+  leaf.lo = leaf.hi = position;
+  this->refitAbove(this->leaves[light]);
+}
+
+inline void LightBvh::refitAbove(uint32_t index) {
+  while (index != 0) {
+    index = this->nodes[index].parent;
+    Node &node = this->nodes[index];
+    const Node &a = this->nodes[index + 1];
+    const Node &b = this->nodes[node.index];
+    node.lo = glm::min(a.lo, b.lo);
+    node.hi = glm::max(a.hi, b.hi);
+    node.power = a.power + b.power;
+  }
+}
+
+inline float LightBvh::getImportance(const Node &node, glm::vec3 point,
+                                     glm::vec3 normal) const {
+  if (node.power <= 0.0f) {
+    return 0.0f;
+  }
+  // the corner of the bounds farthest along the normal, a node entirely
+  // behind the surface gets nothing
+  glm::vec3 corner(normal.x > 0.0f ? node.hi.x : node.lo.x,
+                   normal.y > 0.0f ? node.hi.y : node.lo.y,
+                   normal.z > 0.0f ? node.hi.z : node.lo.z);
+  if (glm::dot(normal, corner - point) <= 0.0f) {
+    return 0.0f;
+  }
+  glm::vec3 center = 0.5f * (node.lo + node.hi);
+  glm::vec3 toCenter = center - point;
+  float d2 = glm::dot(toCenter, toCenter);
+  glm::vec3 halfExtent = 0.5f * (node.hi - node.lo);
+  float r2 = glm::dot(halfExtent, halfExtent);
+
+  // no light of the node is closer than the distance to the bounding
+  // sphere, or the radius when the point is inside it
+  float nearest2 = std::max(d2, r2);
+  float nearest = std::sqrt(nearest2);
+  float attenuation =
+      1.0f / (node.attenuationConstant + node.attenuationLinear * nearest +
+              node.attenuationQuadratic * nearest2);
+
+  // largest cosine toward the bounding sphere
+  float cosBound = 1.0f;
+  if (d2 > r2) {
+    float invD = 1.0f / std::sqrt(d2);
+    float cosTheta = glm::dot(normal, toCenter) * invD;
+    float sin2Sphere = r2 / d2;
+    float cosSphere = std::sqrt(1.0f - sin2Sphere);
+    if (cosTheta < cosSphere) {
+      float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+      cosBound = cosTheta * cosSphere + sinTheta * std::sqrt(sin2Sphere);
+    }
+  } else if (r2 == 0.0f) {
+    // a light at the shading point
+    cosBound = 0.0f;
+  }
+  return cosBound > 0.0f ? node.power * attenuation * cosBound : 0.0f;
+}
+
+inline bool LightBvh::sample(glm::vec3 point, glm::vec3 normal, float u,
+                             uint32_t &light, float &pmf) const {
+  if (this->nodes.empty() ||
+      this->getImportance(this->nodes[0], point, normal) <= 0.0f) {
+    return false;
+  }
+  uint32_t index = 0;
+  float p = 1.0f;
+  while (!this->nodes[index].leaf) {
+    uint32_t first = index + 1;
+    uint32_t second = this->nodes[index].index;
+    float a = this->getImportance(this->nodes[first], point, normal);
+    float b = this->getImportance(this->nodes[second], point, normal);
+    if (a + b <= 0.0f) {
+      return false;
+    }
+    // u is rescaled to stay uniform in the chosen branch
+    float pa = a / (a + b);
+    if (u < pa) {
+      u = std::min(u / pa, 0.99999994f);
+      p *= pa;
+      index = first;
+    } else {
+      u = std::min((u - pa) / (1.0f - pa), 0.99999994f);
+      p *= 1.0f - pa;
+      index = second;
+    }
+  }
+  light = this->nodes[index].index;
+  pmf = p;
+  return true;
+}
+
+inline float LightBvh::getPmf(glm::vec3 point, glm::vec3 normal,
+                              uint32_t light) const {
+  if (light >= this->leaves.size() ||
+      this->getImportance(this->nodes[0], point, normal) <= 0.0f) {
+    return 0.0f;
+  }
+  float p = 1.0f;
+  uint32_t index = this->leaves[light];
+  while (index != 0) {
+    uint32_t parent = this->nodes[index].parent;
+    uint32_t first = parent + 1;
+    uint32_t second = this->nodes[parent].index;
+    float a = this->getImportance(this->nodes[first], point, normal);
+    float b = this->getImportance(this->nodes[second], point, normal);
+    if (a + b <= 0.0f) {
+      return 0.0f;
+    }
+    p *= (index == first ? a : b) / (a + b);
+    index = parent;
+  }
+  return p;
+}
+
+#endif
@@ -0,0 +1,126 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+/* Read only memory mapping of a whole file.
+   Pages are brought in by the kernel when they are first touched and stay
+   shared with the page cache, so opening a large file costs nothing until
+   it is read. Move only, the mapping is released with the object.
+ */
+class MappedFile {
+public:
+  MappedFile() {}
+  ~MappedFile() { this->close(); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  // false if the file can not be opened or is empty
+  bool open(const std::string &path);
+  void close();
+
+  bool isOpen() const { return this->bytes != nullptr; }
+  const unsigned char *data() const { return this->bytes; }
+  std::size_t size() const { return this->length; }
+
+  /* Paging hints for a byte range, widened to whole pages. Dropped pages
+     are read again from the file when touched, so the mapping stays valid
+     for readers either way.
+   */
+  void willNeed(std::size_t offset, std::size_t size) const;
+  void dontNeed(std::size_t offset, std::size_t size) const;
+  static std::size_t getPageSize();
+
+private:
+  const unsigned char *bytes = nullptr;
+  std::size_t length = 0;
+};
+
+inline MappedFile::MappedFile(MappedFile &&other) noexcept
+    : bytes(other.bytes), length(other.length) {
+  other.bytes = nullptr;
+  other.length = 0;
+}
+
+inline MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    this->close();
+    this->bytes = other.bytes;
+    this->length = other.length;
+    other.bytes = nullptr;
+    other.length = 0;
+  }
+  return *this;
+}
+
+inline bool MappedFile::open(const std::string &path) {
+  this->close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  std::size_t size = static_cast<std::size_t>(info.st_size);
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  this->bytes = static_cast<const unsigned char *>(mapped);
+  this->length = size;
+  return true;
+}
+
+inline void MappedFile::close() {
+  if (this->bytes) {
+    munmap(const_cast<unsigned char *>(this->bytes), this->length);
+  }
+  this->bytes = nullptr;
+  this->length = 0;
+}
+
+inline std::size_t MappedFile::getPageSize() {
+  static const std::size_t pageSize =
+      static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  return pageSize;
+}
+
+inline void MappedFile::willNeed(std::size_t offset, std::size_t size) const {
+  std::size_t page = getPageSize();
+  std::size_t first = offset / page * page;
+  if (this->bytes && first < this->length) {
+    size = std::min(size + (offset - first), this->length - first);
+    madvise(const_cast<unsigned char *>(this->bytes) + first, size,
+            MADV_WILLNEED);
+  }
+}
+
+inline void MappedFile::dontNeed(std::size_t offset, std::size_t size) const {
+  std::size_t page = getPageSize();
+  std::size_t first = offset / page * page;
+  if (this->bytes && first < this->length) {
+    size = std::min(size + (offset - first), this->length - first);
+    madvise(const_cast<unsigned char *>(this->bytes) + first, size,
+            MADV_DONTNEED);
+  }
+}
+
+#endif
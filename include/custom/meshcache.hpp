@@ -0,0 +1,371 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <custom/geometry.hpp>
+#include <custom/mappedfile.hpp>
+#include <custom/texturecache.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+const uint32_t MESH_CACHE_MAGIC = 0x434d4949u; // "IIMC"
+// bump whenever the layout of the file or of GeometryMesh changes, or
+// when the import produces different arrays for the same model
+const uint32_t MESH_CACHE_VERSION = 2;
+
+// what a cache file was built from, any difference makes it stale
+struct MeshCacheKey {
+  uint64_t pathHash = 0;
+  uint64_t sourceSize = 0;
+  int64_t sourceTime = 0;
+  uint64_t importFlags = 0;
+};
+
+inline bool operator==(const MeshCacheKey &a, const MeshCacheKey &b) {
+  return a.pathHash == b.pathHash && a.sourceSize == b.sourceSize &&
+         a.sourceTime == b.sourceTime && a.importFlags == b.importFlags;
+}
+
+// false if the source file does not exist
+inline bool makeMeshCacheKey(const std::string &path, unsigned int flags,
+                             MeshCacheKey &key) {
+  std::error_code err;
+  std::string name = std::filesystem::weakly_canonical(path, err).string();
+  if (err) {
+    name = path;
+  }
+  uint64_t size = std::filesystem::file_size(path, err);
+  if (err) {
+    return false;
+  }
+  auto time = std::filesystem::last_write_time(path, err);
+  if (err) {
+    return false;
+  }
+  key.pathHash = hashBytes(
+      reinterpret_cast<const unsigned char *>(name.data()), name.size());
+  key.sourceSize = size;
+  key.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+  key.importFlags = flags;
+  return true;
+}
+
+// the cache lives next to the model it was built from
+inline std::string getMeshCachePath(const std::string &path) {
+  return path + ".meshcache";
+}
+
+// sections of the file, in file order
+enum MeshCacheSection {
+  MESH_CACHE_POSITIONS,
+  MESH_CACHE_NORMALS,
+  MESH_CACHE_UVS,
+  MESH_CACHE_TANGENTS,
+  MESH_CACHE_BITANGENTS,
+  MESH_CACHE_INDICES,
+  MESH_CACHE_TRIANGLE_MATERIALS,
+  MESH_CACHE_MESHES,
+  MESH_CACHE_MATERIALS,
+  MESH_CACHE_STRINGS,
+  MESH_CACHE_SECTION_COUNT
+};
+
+// sections start on this boundary so the arrays can be used in place
+const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  MeshCacheKey key;
+  uint64_t vertexCount;
+  uint64_t tangentCount;
+  uint64_t indexCount;
+  uint64_t meshCount;
+  uint64_t materialCount;
+  uint64_t offsets[MESH_CACHE_SECTION_COUNT];
+  uint64_t sizes[MESH_CACHE_SECTION_COUNT];
+};
+
+// materials hold strings, they are stored as ranges of the string section
+struct MeshCacheMaterial {
+  float diffuseColor[3];
+  uint32_t pathOffsets[4];
+  uint32_t pathLengths[4];
+};
+
+/* Post processed geometry of a model, mapped from disk.
+   A warm load is one mmap and a check of the file: the vertex streams and
+   the indices are used where they lie in the mapping, nothing is parsed or
+   copied. Only the few materials are decoded into strings. The check
+   reads the header and the mesh table, so a truncated file or one whose
+   ranges do not fit is rejected instead of read past its end; it does
+   not touch the indices, which are only written whole and renamed into
+   place. verify also scans every index and triangle material, which
+   pages in those sections and costs a full read of a large model.
+ */
+class MeshCache {
+public:
+  // false if the file is missing, from another version or stale for key
+  bool open(const std::string &cachePath, const MeshCacheKey &key,
+            bool verify = false);
+  bool isOpen() const { return this->file.isOpen(); }
+  GeometryView getView() const { return this->view; }
+  std::vector<GeometryMaterial> getMaterials() const;
+
+private:
+  MappedFile file;
+  GeometryView view;
+
+  const unsigned char *section(MeshCacheSection s) const;
+  // every section fits the file and holds what the header counts
+  bool isValid(const MeshCacheKey &key) const;
+  // every index and triangle material is in range
+  bool verifyElements() const;
+};
+
+inline bool writeMeshCache(const std::string &cachePath,
+                           const MeshCacheKey &key, const SceneGeometry &g) {
+  // written to a temporary file and renamed, a reader never maps a
+  // half written cache
+  std::vector<MeshCacheMaterial> materials(g.materials.size());
+  std::string strings;
+  for (std::size_t i = 0; i < g.materials.size(); i++) {
+    const GeometryMaterial &m = g.materials[i];
+    const std::string *paths[4] = {&m.diffusePath, &m.specularPath,
+                                   &m.normalPath, &m.heightPath};
+    MeshCacheMaterial &out = materials[i];
+    std::memcpy(out.diffuseColor, &m.diffuseColor[0], sizeof(float) * 3);
+    for (int k = 0; k < 4; k++) {
+      out.pathOffsets[k] = static_cast<uint32_t>(strings.size());
+      out.pathLengths[k] = static_cast<uint32_t>(paths[k]->size());
+      strings += *paths[k];
+    }
+  }
+
+  const void *data[MESH_CACHE_SECTION_COUNT] = {
+      g.positions.data(),         g.normals.data(),    g.uvs.data(),
+      g.tangents.data(),          g.bitangents.data(), g.indices.data(),
+      g.triangleMaterials.data(), g.meshes.data(),     materials.data(),
+      strings.data()};
+  MeshCacheHeader header{};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.key = key;
+  header.vertexCount = g.positions.size();
+  header.tangentCount = g.tangents.size();
+  header.indexCount = g.indices.size();
+  header.meshCount = g.meshes.size();
+  header.materialCount = materials.size();
+  header.sizes[MESH_CACHE_POSITIONS] = g.positions.size() * sizeof(glm::vec3);
+  header.sizes[MESH_CACHE_NORMALS] = g.normals.size() * sizeof(glm::vec3);
+  header.sizes[MESH_CACHE_UVS] = g.uvs.size() * sizeof(glm::vec2);
+  header.sizes[MESH_CACHE_TANGENTS] = g.tangents.size() * sizeof(glm::vec3);
+  header.sizes[MESH_CACHE_BITANGENTS] =
+      g.bitangents.size() * sizeof(glm::vec3);
+  header.sizes[MESH_CACHE_INDICES] = g.indices.size() * sizeof(unsigned int);
+  header.sizes[MESH_CACHE_TRIANGLE_MATERIALS] =
+      g.triangleMaterials.size() * sizeof(int);
+  header.sizes[MESH_CACHE_MESHES] = g.meshes.size() * sizeof(GeometryMesh);
+  header.sizes[MESH_CACHE_MATERIALS] =
+      materials.size() * sizeof(MeshCacheMaterial);
+  header.sizes[MESH_CACHE_STRINGS] = strings.size();
+  uint64_t offset = sizeof(MeshCacheHeader);
+  for (int s = 0; s < MESH_CACHE_SECTION_COUNT; s++) {
+    offset = (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT *
+             MESH_CACHE_ALIGNMENT;
+    header.offsets[s] = offset;
+    offset += header.sizes[s];
+  }
+
+  std::string tempPath = cachePath + ".tmp";
+  std::error_code err;
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    const char padding[MESH_CACHE_ALIGNMENT] = {};
+    for (int s = 0; s < MESH_CACHE_SECTION_COUNT; s++) {
+      out.write(padding,
+                static_cast<std::streamsize>(header.offsets[s] - written));
+      out.write(static_cast<const char *>(data[s]),
+                static_cast<std::streamsize>(header.sizes[s]));
+      written = header.offsets[s] + header.sizes[s];
+    }
+    // the close flushes, a failed flush must not be renamed over the cache
+    out.close();
+    if (!out) {
+      std::filesystem::remove(tempPath, err);
+      return false;
+    }
+  }
+  std::filesystem::rename(tempPath, cachePath, err);
+  if (err) {
+    std::filesystem::remove(tempPath, err);
+    return false;
+  }
+  return true;
+}
+
+inline const unsigned char *MeshCache::section(MeshCacheSection s) const {
+  const MeshCacheHeader *header =
+      reinterpret_cast<const MeshCacheHeader *>(this->file.data());
+  return this->file.data() + header->offsets[s];
+}
+
+inline bool MeshCache::isValid(const MeshCacheKey &key) const {
+  const uint64_t fileSize = this->file.size();
+  if (fileSize < sizeof(MeshCacheHeader)) {
+    return false;
+  }
+  const MeshCacheHeader *header =
+      reinterpret_cast<const MeshCacheHeader *>(this->file.data());
+  if (header->magic != MESH_CACHE_MAGIC ||
+      header->version != MESH_CACHE_VERSION || !(header->key == key)) {
+    return false;
+  }
+  // a truncated file must not hand out pointers past the mapping
+  for (int s = 0; s < MESH_CACHE_SECTION_COUNT; s++) {
+    if (header->offsets[s] % MESH_CACHE_ALIGNMENT != 0 ||
+        header->offsets[s] > fileSize ||
+        header->sizes[s] > fileSize - header->offsets[s]) {
+      return false;
+    }
+  }
+  // counts are bounded by the file first, so the products cannot wrap
+  const uint64_t counts[MESH_CACHE_STRINGS] = {
+      header->vertexCount,    header->vertexCount, header->vertexCount,
+      header->tangentCount,   header->tangentCount, header->indexCount,
+      header->indexCount / 3, header->meshCount,   header->materialCount};
+  const uint64_t elementSizes[MESH_CACHE_STRINGS] = {
+      sizeof(glm::vec3), sizeof(glm::vec3),    sizeof(glm::vec2),
+      sizeof(glm::vec3), sizeof(glm::vec3),    sizeof(unsigned int),
+      sizeof(int),       sizeof(GeometryMesh), sizeof(MeshCacheMaterial)};
+  for (int s = 0; s < MESH_CACHE_STRINGS; s++) {
+    if (counts[s] > fileSize / elementSizes[s] ||
+        header->sizes[s] != counts[s] * elementSizes[s]) {
+      return false;
+    }
+  }
+  if (header->indexCount % 3 != 0) {
+    return false;
+  }
+
+  const GeometryMesh *meshes = reinterpret_cast<const GeometryMesh *>(
+      this->section(MESH_CACHE_MESHES));
+  for (uint64_t m = 0; m < header->meshCount; m++) {
+    const GeometryMesh &mesh = meshes[m];
+    if (uint64_t(mesh.firstVertex) + mesh.vertexCount > header->vertexCount ||
+        uint64_t(mesh.firstIndex) + mesh.indexCount > header->indexCount ||
+        mesh.firstIndex % 3 != 0 || mesh.indexCount % 3 != 0 ||
+        mesh.materialId < 0 ||
+        uint64_t(mesh.materialId) >= header->materialCount) {
+      return false;
+    }
+    if (mesh.hasTangents() && uint64_t(mesh.firstTangent) + mesh.vertexCount >
+                                  header->tangentCount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool MeshCache::verifyElements() const {
+  const MeshCacheHeader *header =
+      reinterpret_cast<const MeshCacheHeader *>(this->file.data());
+  const int *triangleMaterials = reinterpret_cast<const int *>(
+      this->section(MESH_CACHE_TRIANGLE_MATERIALS));
+  for (uint64_t t = 0; t < header->indexCount / 3; t++) {
+    if (triangleMaterials[t] < 0 ||
+        uint64_t(triangleMaterials[t]) >= header->materialCount) {
+      return false;
+    }
+  }
+  const unsigned int *indices = reinterpret_cast<const unsigned int *>(
+      this->section(MESH_CACHE_INDICES));
+  // the largest index decides, one branch free pass
+  unsigned int largest = 0;
+  for (uint64_t i = 0; i < header->indexCount; i++) {
+    largest = std::max(largest, indices[i]);
+  }
+  return header->indexCount == 0 || largest < header->vertexCount;
+}
+
+inline bool MeshCache::open(const std::string &cachePath,
+                            const MeshCacheKey &key, bool verify) {
+  if (!this->file.open(cachePath)) {
+    return false;
+  }
+  if (!this->isValid(key) || (verify && !this->verifyElements())) {
+    this->file.close();
+    return false;
+  }
+  const MeshCacheHeader *header =
+      reinterpret_cast<const MeshCacheHeader *>(this->file.data());
+
+  GeometryView &v = this->view;
+  v.positions =
+      reinterpret_cast<const glm::vec3 *>(this->section(MESH_CACHE_POSITIONS));
+  v.normals =
+      reinterpret_cast<const glm::vec3 *>(this->section(MESH_CACHE_NORMALS));
+  v.uvs = reinterpret_cast<const glm::vec2 *>(this->section(MESH_CACHE_UVS));
+  v.tangents =
+      reinterpret_cast<const glm::vec3 *>(this->section(MESH_CACHE_TANGENTS));
+  v.bitangents = reinterpret_cast<const glm::vec3 *>(
+      this->section(MESH_CACHE_BITANGENTS));
+  v.indices = reinterpret_cast<const unsigned int *>(
+      this->section(MESH_CACHE_INDICES));
+  v.triangleMaterials = reinterpret_cast<const int *>(
+      this->section(MESH_CACHE_TRIANGLE_MATERIALS));
+  v.meshes = reinterpret_cast<const GeometryMesh *>(
+      this->section(MESH_CACHE_MESHES));
+  v.vertexCount = header->vertexCount;
+  v.tangentCount = header->tangentCount;
+  v.indexCount = header->indexCount;
+  v.meshCount = header->meshCount;
+  return true;
+}
+
+inline std::vector<GeometryMaterial> MeshCache::getMaterials() const {
+  std::vector<GeometryMaterial> materials;
+  if (!this->isOpen()) {
+    return materials;
+  }
+  const MeshCacheHeader *header =
+      reinterpret_cast<const MeshCacheHeader *>(this->file.data());
+  const MeshCacheMaterial *records =
+      reinterpret_cast<const MeshCacheMaterial *>(
+          this->section(MESH_CACHE_MATERIALS));
+  const char *strings =
+      reinterpret_cast<const char *>(this->section(MESH_CACHE_STRINGS));
+  uint64_t stringSize = header->sizes[MESH_CACHE_STRINGS];
+  materials.resize(header->materialCount);
+  for (std::size_t i = 0; i < materials.size(); i++) {
+    const MeshCacheMaterial &r = records[i];
+    GeometryMaterial &m = materials[i];
+    std::string *paths[4] = {&m.diffusePath, &m.specularPath, &m.normalPath,
+                             &m.heightPath};
+    m.diffuseColor =
+        glm::vec3(r.diffuseColor[0], r.diffuseColor[1], r.diffuseColor[2]);
+    for (int k = 0; k < 4; k++) {
+      uint64_t end = uint64_t(r.pathOffsets[k]) + r.pathLengths[k];
+      if (end <= stringSize) {
+        paths[k]->assign(strings + r.pathOffsets[k], r.pathLengths[k]);
+      }
+    }
+  }
+  return materials;
+}
+
+#endif
@@ -11,39 +11,93 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 // load image
-#define STB_IMAGE_IMPLEMENTATION
-#include <custom/stb_image.h>
+#include <custom/imagedecode.hpp>
 
 // mesh shader
 #include <custom/mesh.hpp>
 #include <custom/shader.hpp>
 
+// textures shared by every model
+#include <custom/texturecache.hpp>
+
+// meshes are converted on all cores
+#include <custom/parallel.hpp>
+#include <custom/tangents.hpp>
+
 // assimp model loading library
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
 //
+#include <cstdlib>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 // end declare libs
 
+/* Pixels of an image file, decoded by decodeImage on a worker thread.
+   The gl texture is made from it later on the gl thread, which then frees
+   the pixels; textureIds let every model that finds the image in the
+   cache reuse that texture, one per gamma setting, linear first. All are
+   only touched on the gl thread.
+ */
+struct DecodedImage {
+  int width = 0;
+  int height = 0;
+  int nrComponents = 0;
+  unsigned char *pixels = nullptr;
+  unsigned int textureIds[2] = {0, 0};
+
+  DecodedImage() {}
+  ~DecodedImage() { this->releasePixels(); }
+  DecodedImage(const DecodedImage &) = delete;
+  DecodedImage &operator=(const DecodedImage &) = delete;
+  void releasePixels() {
+    std::free(this->pixels);
+    this->pixels = nullptr;
+  }
+};
+
+using ImageCache = TextureCacheT<std::shared_ptr<DecodedImage>>;
+
 // function declarations
 unsigned int loadTextureFromFile(const char *path, const std::string &directory,
                                  bool gamma = false);
+ImageCache::Future requestTextureFromFile(const char *path,
+                                          const std::string &directory);
+unsigned int finishTexture(const ImageCache::Future &image, const char *path,
+                           const std::string &directory, bool gamma = false);
+unsigned int uploadTexture(const unsigned char *data, int width, int height,
+                           int nrComponents, bool gamma = false);
 
 // class declarations
 
+// cpu side result of processMesh, turned into a Mesh on the gl thread
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  unsigned int materialIndex;
+};
+
 class Model {
 public:
 
   bool gammaCorrection;
   std::vector<Mesh> meshes;
   std::vector<Texture> loadedTextures;
+  // position of every texture path in loadedTextures
+  std::unordered_map<std::string, std::size_t> loadedTextureIndex;
+  // textures of every material index that has been resolved
+  std::map<unsigned int, std::vector<Texture>> materialTextures;
+  // decodes queued by loadModel, keyed by the path in the material
+  std::unordered_map<std::string, ImageCache::Future> pendingTextures;
   std::string directory;
   // constructor
   Model(const char* path, bool gamma = false) : gammaCorrection(gamma)
@@ -55,8 +109,13 @@ private:
   // model data
   // functions
   void loadModel(std::string path);
-  void processNode(aiNode *node, const aiScene *scene);
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+  void processNode(aiNode *node, const aiScene *scene,
+                   std::vector<aiMesh *> &work);
+  void processMesh(aiMesh *mesh, MeshData &data, bool withTangents);
+  bool needsTangents(const aiScene *scene, const aiMesh *mesh) const;
+  void requestTextures(const aiScene *scene);
+  const std::vector<Texture> &getMaterialTextures(const aiScene *scene,
+                                                 unsigned int materialIndex);
   std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
                                             std::string typeName);
 };
@@ -72,8 +131,7 @@ void Model::loadModel(std::string path) {
   // read the file with assimp
   Assimp::Importer importer;
   const aiScene *scene =
-      importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs |
-                                  aiProcess_CalcTangentSpace);
+      importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
   /*
 We first declare an actual Importer object from Assimp's namespace and then
 call its ReadFile function. The function expects a file path and as its
@@ -85,8 +143,9 @@ consist of triangles it should transform all the model's primitive shapes to
 triangles. The aiProcess_FlipUVs flips the texture coordinates on the y-axis
 where necessary during processing (you might remember from the Textures
 tutorial that most images in OpenGL were reversed around the y-axis so this
-little postprocessing option fixes that for us). A few other useful options
-are:
+little postprocessing option fixes that for us). Tangent frames are not
+asked for with aiProcess_CalcTangentSpace, processMesh computes them only
+for the meshes that have a normal map. A few other useful options are:
 
   aiProcess_GenNormals : actually creates normals for each vertex if the
   model didn't contain normal vectors.
@@ -109,78 +168,156 @@ translate the loaded data to an array of Mesh objects.
   }
   directory = path.substr(0, path.find_last_of('/'));
 
-  // start processing from root node recursively
-  this->processNode(scene->mRootNode, scene);
+  // flatten the node tree into the list of meshes to convert
+  std::vector<aiMesh *> work;
+  this->processNode(scene->mRootNode, scene, work);
+
+  // every texture starts decoding on the worker pool before the meshes
+  this->requestTextures(scene);
+
+  /*
+Converting a mesh only reads the scene and writes its own slot so the meshes
+are processed concurrently, while the textures decode. Uploading textures and
+the Mesh constructor talk to opengl, they stay on this thread and run
+afterwards in the original order.
+   */
+  std::vector<MeshData> data(work.size());
+  parallelFor(
+      0, work.size(),
+      [&](std::size_t i) {
+        this->processMesh(work[i], data[i],
+                          this->needsTangents(scene, work[i]));
+      },
+      0, 1);
+
+  this->meshes.reserve(this->meshes.size() + work.size());
+  for (std::size_t i = 0; i < data.size(); i++) {
+    // now deal with materials
+    /*
+Just like with nodes, a mesh only contains an index to a material object and
+to retrieve the actual material of a mesh we need to index the scene's
+mMaterials array. The material is the same for every face of the mesh so it is
+resolved once per mesh, and once per material for the whole model.
+     */
+    std::vector<Texture> textures;
+    if (data[i].materialIndex < scene->mNumMaterials) {
+      textures = this->getMaterialTextures(scene, data[i].materialIndex);
+    }
+    // the arrays are handed over, not copied
+    this->meshes.emplace_back(std::move(data[i].vertices),
+                              std::move(data[i].indices), std::move(textures));
+  }
+  this->pendingTextures.clear();
+}
+
+void Model::requestTextures(const aiScene *scene) {
+  // same texture slots as getMaterialTextures
+  const aiTextureType types[] = {aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+                                 aiTextureType_HEIGHT, aiTextureType_AMBIENT};
+  for (unsigned int m = 0; m < scene->mNumMaterials; m++) {
+    aiMaterial *mat = scene->mMaterials[m];
+    for (aiTextureType type : types) {
+      for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        std::string texPath(str.C_Str());
+        if (this->loadedTextureIndex.count(texPath) == 0 &&
+            this->pendingTextures.count(texPath) == 0) {
+          this->pendingTextures[texPath] =
+              requestTextureFromFile(texPath.c_str(), this->directory);
+        }
+      }
+    }
+  }
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
-  // process the meshes of the given node on scene
+void Model::processNode(aiNode *node, const aiScene *scene,
+                        std::vector<aiMesh *> &work) {
+  // collect the meshes of the given node on scene
   for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    this->meshes.push_back(this->processMesh(mesh, scene));
+    work.push_back(scene->mMeshes[node->mMeshes[i]]);
   }
-  // now all meshes of this node has been processed
+  // now all meshes of this node has been collected
   // we should continue to meshes of child nodes
   for (unsigned int k = 0; k < node->mNumChildren; k++) {
-    this->processNode(node->mChildren[k], scene);
+    this->processNode(node->mChildren[k], scene, work);
   }
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
+bool Model::needsTangents(const aiScene *scene, const aiMesh *mesh) const {
+  // normal maps are read from the height slot, see getMaterialTextures
+  return mesh->mMaterialIndex < scene->mNumMaterials &&
+         scene->mMaterials[mesh->mMaterialIndex]->GetTextureCount(
+             aiTextureType_HEIGHT) > 0;
+}
+
+void Model::processMesh(aiMesh *mesh, MeshData &data, bool withTangents) {
   // process meshes
   /*
 Processing a mesh basically consists of 3 sections: retrieving all the vertex
 data, retrieving the mesh's indices and finally retrieving the relevant
-material data. The processed data is stored in one of the 3 vectors and from
-those a Mesh is created and returned to the function's caller.
+material data. The vertex and index data is stored in the slot of the mesh,
+the material is resolved by loadModel since it loads textures.
    */
 
   // data
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
-  std::vector<Texture> textures;
+  std::vector<Vertex> &vertices = data.vertices;
+  std::vector<unsigned int> &indices = data.indices;
+  data.materialIndex = mesh->mMaterialIndex;
+
+  // both arrays are sized once from the mesh and filled in place
+  vertices.resize(mesh->mNumVertices);
+  std::size_t indexCount = 0;
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    indexCount += mesh->mFaces[i].mNumIndices;
+  }
+  indices.resize(indexCount);
+
+  // tangent frames are derived here, the other meshes leave them zero
+  std::vector<glm::vec3> tangents, bitangents;
+  if (withTangents) {
+    tangents.resize(mesh->mNumVertices);
+    bitangents.resize(mesh->mNumVertices);
+    if (!computeTangentFrames(mesh, tangents.data(), bitangents.data())) {
+      tangents.clear();
+      bitangents.clear();
+    }
+  }
 
   // iteration on vertices of the mesh
+  const aiVector3D *texCoords = mesh->mTextureCoords[0];
   for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-    Vertex vertice;
-    // place holder
-    glm::vec3 vec;
-    vec.x = mesh->mVertices[i].x;
-    vec.y = mesh->mVertices[i].y;
-    vec.z = mesh->mVertices[i].z;
-    // add to vertice
-    vertice.position = vec;
+    Vertex &vertice = vertices[i];
+    // position
+    const aiVector3D &p = mesh->mVertices[i];
+    vertice.position = glm::vec3(p.x, p.y, p.z);
     // normals
-    vec.x = mesh->mNormals[i].x;
-    vec.y = mesh->mNormals[i].y;
-    vec.z = mesh->mNormals[i].z;
-    vertice.normal = vec;
+    if (mesh->mNormals) {
+      const aiVector3D &n = mesh->mNormals[i];
+      vertice.normal = glm::vec3(n.x, n.y, n.z);
+    } else {
+      vertice.normal = glm::vec3(0.0f);
+    }
 
     // texture coordinates
-    if (mesh->mTextureCoords[0]) // if it contains texture coordinates
+    if (texCoords) // if it contains texture coordinates
     {
-      glm::vec2 vect;
-      vect.x = mesh->mTextureCoords[i]->x;
-      vect.y = mesh->mTextureCoords[i]->y;
-      vertice.TexCoords = vect;
+      vertice.TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
     } else {
       vertice.TexCoords = glm::vec2(0.0f, 0.0f);
     }
 
-    // now onto tangent
-    vec.x = mesh->mTangents[i].x;
-    vec.y = mesh->mTangents[i].y;
-    vec.z = mesh->mTangents[i].z;
-    vertice.Tangent = vec;
-
-    // and finally bitangent
-    vec.x = mesh->mBitangents[i].x;
-    vec.y = mesh->mBitangents[i].y;
-    vec.z = mesh->mBitangents[i].z;
-    vertice.BiTangent = vec;
-    vertices.push_back(vertice);
+    // now onto tangent and bitangent
+    if (!tangents.empty()) {
+      vertice.Tangent = tangents[i];
+      vertice.BiTangent = bitangents[i];
+    } else {
+      vertice.Tangent = glm::vec3(0.0f);
+      vertice.BiTangent = glm::vec3(0.0f);
+    }
   }
   // vertice iteration done now we should deal with indices
+  unsigned int *out = indices.data();
   for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
     /*
 Assimp's interface defined each mesh having an array of faces where each face
@@ -188,43 +325,45 @@ represents a single primitive, which in our case (due to the
 aiProcess_Triangulate option) are always triangles. A face contains the
 indices that define which vertices we need to draw in what order for each
 primitive so if we iterate over all the faces and store all the face's indices
-in the indices vector we're all set
+in the indices vector we're all set. The face is taken by reference, copying
+an aiFace allocates a copy of its index array.
      */
-    aiFace face = mesh->mFaces[i];
+    const aiFace &face = mesh->mFaces[i];
     for (unsigned int k = 0; k < face.mNumIndices; k++) {
-      indices.push_back(face.mIndices[k]);
-    }
-    // now deal with materials
-    if (mesh->mMaterialIndex >= 0) {
-      aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-      /*
-Just like with nodes, a mesh only contains an index to a material object and
-to retrieve the actual material of a mesh we need to index the scene's
-mMaterials array. The mesh's material index is set in its mMaterialIndex
-property which we can also query to check if the mesh actually contains a
-material or not
-       */
-      // we retrieve textures
-      // 1. diffuse maps
-      std::vector<Texture> diffuseMaps = this->loadMaterialTextures(
-          material, aiTextureType_DIFFUSE, "texture_diffuse");
-      textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-      // 2. specular maps
-      std::vector<Texture> specularMaps = this->loadMaterialTextures(
-          material, aiTextureType_SPECULAR, "texture_specular");
-      textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-      // 3. normal maps
-      std::vector<Texture> normalMaps = this->loadMaterialTextures(
-          material, aiTextureType_HEIGHT, "texture_normal");
-      textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-
-      // 4. height maps
-      std::vector<Texture> heightMaps = this->loadMaterialTextures(
-          material, aiTextureType_AMBIENT, "texture_height");
-      textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+      *out++ = face.mIndices[k];
     }
   }
-  return Mesh(vertices, indices, textures);
+}
+
+const std::vector<Texture> &
+Model::getMaterialTextures(const aiScene *scene, unsigned int materialIndex) {
+  // textures of a material are looked up once and reused by every mesh
+  std::map<unsigned int, std::vector<Texture>>::iterator it =
+      this->materialTextures.find(materialIndex);
+  if (it != this->materialTextures.end()) {
+    return it->second;
+  }
+  aiMaterial *material = scene->mMaterials[materialIndex];
+  std::vector<Texture> textures;
+  // we retrieve textures
+  // 1. diffuse maps
+  std::vector<Texture> diffuseMaps = this->loadMaterialTextures(
+      material, aiTextureType_DIFFUSE, "texture_diffuse");
+  textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+  // 2. specular maps
+  std::vector<Texture> specularMaps = this->loadMaterialTextures(
+      material, aiTextureType_SPECULAR, "texture_specular");
+  textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+  // 3. normal maps
+  std::vector<Texture> normalMaps = this->loadMaterialTextures(
+      material, aiTextureType_HEIGHT, "texture_normal");
+  textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+
+  // 4. height maps
+  std::vector<Texture> heightMaps = this->loadMaterialTextures(
+      material, aiTextureType_AMBIENT, "texture_height");
+  textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+  return this->materialTextures[materialIndex] = textures;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat,
@@ -234,71 +373,127 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat,
   for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
     aiString str;
     mat->GetTexture(type, i, &str);
-    const char *newTexPath = str.C_Str();
+    std::string newTexPath(str.C_Str());
     // check if the texture is loaded before
-    bool skipCheck = false;
-    for (unsigned int j = 0; j < this->loadedTextures.size(); j++) {
-      const char *pdata = this->loadedTextures[j].path.data();
-      if (std::strcmp(pdata, newTexPath) == 0) {
-        // texture with same path has already been loaded
-        texvec.push_back(this->loadedTextures[j]);
-        skipCheck = true;
-        break;
-      }
+    std::unordered_map<std::string, std::size_t>::iterator it =
+        this->loadedTextureIndex.find(newTexPath);
+    if (it != this->loadedTextureIndex.end()) {
+      // texture with same path has already been loaded
+      texvec.push_back(this->loadedTextures[it->second]);
+      continue;
     }
-    if (!skipCheck) { // texture is not loaded so let's load it
-      Texture tex;
-      tex.id = loadTextureFromFile(newTexPath, this->directory);
-      tex.type = typeName;
-      tex.path = newTexPath;
-      texvec.push_back(tex);
-      this->loadedTextures.push_back(tex);
+    // texture is not loaded by this model, its decode was queued by
+    // requestTextures and is normally done by now
+    Texture tex;
+    std::unordered_map<std::string, ImageCache::Future>::iterator pending =
+        this->pendingTextures.find(newTexPath);
+    if (pending != this->pendingTextures.end()) {
+      tex.id = finishTexture(pending->second, newTexPath.c_str(),
+                             this->directory, this->gammaCorrection);
+    } else {
+      tex.id = loadTextureFromFile(newTexPath.c_str(), this->directory,
+                                   this->gammaCorrection);
     }
+    tex.type = typeName;
+    tex.path = newTexPath;
+    texvec.push_back(tex);
+    this->loadedTextureIndex[newTexPath] = this->loadedTextures.size();
+    this->loadedTextures.push_back(tex);
   }
   return texvec;
 }
 
-unsigned int loadTextureFromFile(const char *path, const std::string &directory,
-                                 bool gamma) {
-  std::string fname = std::string(path);
-  fname = fname + '/' + directory;
-
+unsigned int uploadTexture(const unsigned char *data, int width, int height,
+                           int nrComponents, bool gamma) {
   // generate texture
   unsigned int texId;
   glGenTextures(1, &texId);
 
-  // load the image with stb image
+  // gamma corrected textures are stored as srgb, sampling linearizes them
+  GLenum format = GL_RGB;
+  GLenum internalFormat = GL_RGB;
+  switch (nrComponents) {
+  case 1:
+    format = internalFormat = GL_RED;
+    break;
+  case 3:
+    format = GL_RGB;
+    internalFormat = gamma ? GL_SRGB : GL_RGB;
+    break;
+  case 4:
+    format = GL_RGBA;
+    internalFormat = gamma ? GL_SRGB_ALPHA : GL_RGBA;
+    break;
+  }
+  glBindTexture(GL_TEXTURE_2D, texId);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
+               GL_UNSIGNED_BYTE, data);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  return texId;
+}
+
+ImageCache::Future requestTextureFromFile(const char *path,
+                                          const std::string &directory) {
+  std::string fname = directory + '/' + std::string(path);
+
+  // the file is mapped once by the cache, stb image decodes from that
+  // memory on a worker thread
+  return ImageCache::getInstance().request(
+      fname, [](const unsigned char *bytes, std::size_t size,
+                std::shared_ptr<DecodedImage> &image) {
+        image = std::make_shared<DecodedImage>();
+        image->pixels = decodeImage(bytes, size, image->width, image->height,
+                                    image->nrComponents);
+        return image->pixels != nullptr;
+      });
+}
+
+unsigned int finishTexture(const ImageCache::Future &image, const char *path,
+                           const std::string &directory, bool gamma) {
+  // waits for the decode and makes the gl texture, on the gl thread
+  const ImageCache::Load &result = image.get();
+  if (!result.loaded) {
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    return 0;
+  }
+  DecodedImage &decoded = *result.handle;
+  unsigned int &textureId = decoded.textureIds[gamma ? 1 : 0];
+  if (textureId != 0) {
+    return textureId;
+  }
+  if (decoded.pixels) {
+    textureId = uploadTexture(decoded.pixels, decoded.width, decoded.height,
+                              decoded.nrComponents, gamma);
+    decoded.releasePixels();
+    return textureId;
+  }
+  // the pixels went to a texture of the other gamma setting, which models
+  // rarely mix, so they are decoded again rather than kept for it
+  MappedFile file;
   int width, height, nrComponents;
-  unsigned char *data =
-      stbi_load(fname.c_str(), &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    switch (nrComponents) {
-    case 1:
-      format = GL_RED;
-      break;
-    case 3:
-      format = GL_RGB;
-      break;
-    case 4:
-      format = GL_RGBA;
-      break;
-    }
-    glBindTexture(GL_TEXTURE_2D, texId);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    stbi_image_free(data);
-  } else {
+  unsigned char *pixels = nullptr;
+  if (file.open(directory + '/' + std::string(path))) {
+    pixels = decodeImage(file.data(), file.size(), width, height,
+                         nrComponents);
+  }
+  if (!pixels) {
     std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
+    return 0;
   }
-  return texId;
+  textureId = uploadTexture(pixels, width, height, nrComponents, gamma);
+  std::free(pixels);
+  return textureId;
+}
+
+unsigned int loadTextureFromFile(const char *path, const std::string &directory,
+                                 bool gamma) {
+  return finishTexture(requestTextureFromFile(path, directory), path,
+                       directory, gamma);
 }
 
 #endif
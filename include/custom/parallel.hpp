@@ -0,0 +1,164 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// number of worker threads to use when the caller does not ask for a count
+inline unsigned int getThreadCount(unsigned int requested = 0) {
+  if (requested != 0) {
+    return requested;
+  }
+  unsigned int hw = std::thread::hardware_concurrency();
+  return hw == 0 ? 1 : hw;
+}
+
+template <typename Function>
+void parallelFor(std::size_t begin, std::size_t end, Function fn,
+                 unsigned int threadCount = 0, std::size_t grainSize = 64) {
+  /* Call fn(i) for every i in [begin, end).
+     Workers pull chunks of grainSize indices from a shared counter so that
+     uneven work per index (adaptive sampling, varying ray depth) still
+     balances across threads. Work stays on the calling thread when there is
+     only one chunk.
+   */
+  if (end <= begin) {
+    return;
+  }
+  grainSize = std::max<std::size_t>(grainSize, 1);
+  std::size_t chunkCount = (end - begin + grainSize - 1) / grainSize;
+  unsigned int workers = static_cast<unsigned int>(
+      std::min<std::size_t>(getThreadCount(threadCount), chunkCount));
+
+  std::atomic<std::size_t> nextChunk(0);
+  auto work = [&]() {
+    for (;;) {
+      std::size_t chunk = nextChunk.fetch_add(1);
+      if (chunk >= chunkCount) {
+        return;
+      }
+      std::size_t first = begin + chunk * grainSize;
+      std::size_t last = std::min(first + grainSize, end);
+      for (std::size_t i = first; i < last; i++) {
+        fn(i);
+      }
+    }
+  };
+  if (workers <= 1) {
+    work();
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (unsigned int t = 1; t < workers; t++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+/* Fixed set of worker threads fed from a fifo queue.
+   parallelFor is for loops the caller waits on; the pool is for work that
+   should proceed while the caller does something else, the result comes
+   back through a future. Queued tasks still run when the pool is
+   destroyed, so no future is left without a value.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <typename Function>
+  std::future<std::invoke_result_t<Function>> submit(Function fn);
+  std::size_t getWorkerCount() const { return this->workers.size(); }
+
+  // process wide pool with one thread per core
+  static ThreadPool &getInstance();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  void run();
+};
+
+inline ThreadPool::ThreadPool(unsigned int threadCount) {
+  unsigned int count = getThreadCount(threadCount);
+  this->workers.reserve(count);
+  for (unsigned int t = 0; t < count; t++) {
+    this->workers.emplace_back([this]() { this->run(); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->wake.notify_all();
+  for (std::thread &t : this->workers) {
+    t.join();
+  }
+}
+
+inline ThreadPool &ThreadPool::getInstance() {
+  static ThreadPool pool;
+  return pool;
+}
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>>
+ThreadPool::submit(Function fn) {
+  using Result = std::invoke_result_t<Function>;
+  // std::function needs a copyable target, the task is shared
+  auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+  std::future<Result> result = task->get_future();
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tasks.emplace_back([task]() { (*task)(); });
+  }
+  this->wake.notify_one();
+  return result;
+}
+
+inline void ThreadPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->wake.wait(lock, [this]() {
+        return this->stopping || !this->tasks.empty();
+      });
+      if (this->tasks.empty()) {
+        // stopping and drained
+        return;
+      }
+      task = std::move(this->tasks.front());
+      this->tasks.pop_front();
+    }
+    task();
+  }
+}
+
+#endif
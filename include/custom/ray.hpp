@@ -0,0 +1,43 @@
+// Author: Kaan Eraslan
+
+// includes
+
+#ifndef RAY_HPP
+#define RAY_HPP
+
+#include <glm/glm.hpp>
+
+// the rendering core is templated on its scalar: float for production,
+// double to validate against
+template <typename T> using Vec3T = glm::vec<3, T, glm::defaultp>;
+template <typename T> using Vec2T = glm::vec<2, T, glm::defaultp>;
+
+template <typename T> struct RayT {
+  Vec3T<T> origin;
+  Vec3T<T> direction;
+
+  Vec3T<T> at(T t) const { return this->origin + t * this->direction; }
+};
+/* Ray with the two rays through the neighbouring pixels in x and y.
+   They are never traced, at a hit they give the footprint of the pixel on
+   the surface, which picks the mip level of a texture lookup.
+ */
+template <typename T> struct RayDifferentialT : RayT<T> {
+  Vec3T<T> rxOrigin;
+  Vec3T<T> rxDirection;
+  Vec3T<T> ryOrigin;
+  Vec3T<T> ryDirection;
+  bool hasDifferentials = false;
+};
+
+template <typename T> struct SegmentT {
+  Vec3T<T> origin;
+  Vec3T<T> direction;
+  T size;
+};
+
+using Ray = RayT<float>;
+using RayDifferential = RayDifferentialT<float>;
+using Segment = SegmentT<float>;
+
+#endif
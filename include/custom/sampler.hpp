@@ -0,0 +1,147 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <custom/framebuffer.hpp>
+#include <custom/parallel.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// small per sample random number generator (pcg hash)
+struct Rng {
+  uint32_t state;
+
+  explicit Rng(uint32_t seed) : state(seed) {}
+  uint32_t nextUint() {
+    uint32_t s = this->state;
+    this->state = s * 747796405u + 2891336453u;
+    uint32_t word = ((s >> ((s >> 28u) + 4u)) ^ s) * 277803737u;
+    return (word >> 22u) ^ word;
+  }
+  // uniform float in [0, 1)
+  float next() { return (this->nextUint() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// pcg output permutation of one word, a bijection on 32 bits
+inline uint32_t hashPcg(uint32_t v) {
+  uint32_t s = v * 747796405u + 2891336453u;
+  uint32_t word = ((s >> ((s >> 28u) + 4u)) ^ s) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+inline Rng makePixelRng(int x, int y, unsigned int sampleIndex) {
+  /* Seed for every pixel and sample. Each coordinate goes through the hash
+     before the next one is mixed in: a linear combination of them maps
+     many (pixel, sample) tuples to one seed and neighbours to correlated
+     streams.
+   */
+  uint32_t seed = hashPcg(static_cast<uint32_t>(x));
+  seed = hashPcg(seed ^ static_cast<uint32_t>(y));
+  seed = hashPcg(seed ^ sampleIndex);
+  return Rng(seed);
+}
+
+struct AdaptiveSettings {
+  // every pixel gets this many samples before its variance is trusted
+  unsigned int minSamples = 8;
+  unsigned int maxSamples = 1024;
+  // samples added to each active pixel per pass
+  unsigned int samplesPerPass = 4;
+  // a pixel keeps receiving passes while its relative error is above this
+  float errorThreshold = 0.01f;
+  /* The render stops once the mean relative error drops below this. It
+     must not be below errorThreshold: pixels stop being sampled once they
+     are under the threshold, and the ones left at maxSamples stay above
+     it, so the mean never gets lower and only maxSamples or timeBudget
+     would end the render. Twice the threshold leaves room for the
+     pixels that hit maxSamples.
+   */
+  float targetNoise = 0.02f;
+  // wall clock budget in seconds, 0 means no limit
+  double timeBudget = 0.0;
+  // 0 picks the hardware concurrency
+  unsigned int threadCount = 0;
+};
+
+struct AdaptiveStats {
+  unsigned int passes = 0;
+  unsigned long long sampleCount = 0;
+  unsigned int activePixels = 0;
+  float meanError = 0.0f;
+  double seconds = 0.0;
+};
+
+template <typename Buffer, typename SampleFunction>
+AdaptiveStats renderAdaptive(Buffer &fb, SampleFunction sample,
+                             const AdaptiveSettings &settings) {
+  /* Render into fb until the image is converged or the budget runs out.
+     sample(x, y, rng) returns a single sample of pixel (x, y): a color for
+     a plain Framebuffer or an AovSample for an AovFramebuffer. The first
+     passes cover every pixel, after that only pixels whose relative error
+     is above the threshold are scheduled again, so flat regions stop
+     costing anything once they are resolved.
+   */
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start = Clock::now();
+  AdaptiveStats stats;
+
+  std::vector<unsigned int> active(fb.pixels.size());
+  for (unsigned int i = 0; i < active.size(); i++) {
+    active[i] = i;
+  }
+
+  while (!active.empty()) {
+    parallelFor(
+        0, active.size(),
+        [&](std::size_t k) {
+          unsigned int index = active[k];
+          int x = index % fb.width;
+          int y = index / fb.width;
+          for (unsigned int s = 0; s < settings.samplesPerPass; s++) {
+            Rng rng = makePixelRng(x, y, fb.pixels[index].sampleCount);
+            fb.addSample(x, y, sample(x, y, rng));
+          }
+        },
+        settings.threadCount);
+    stats.passes++;
+    stats.sampleCount += static_cast<unsigned long long>(active.size()) *
+                         settings.samplesPerPass;
+
+    // reschedule the pixels that are still noisy
+    active.clear();
+    double errorSum = 0.0;
+    for (int y = 0; y < fb.height; y++) {
+      for (int x = 0; x < fb.width; x++) {
+        unsigned int count = fb.getSampleCount(x, y);
+        double err = static_cast<double>(fb.getRelativeError(x, y));
+        errorSum += std::isfinite(err) ? err : 1.0;
+        if (count < settings.minSamples ||
+            (err > settings.errorThreshold && count < settings.maxSamples)) {
+          active.push_back(y * fb.width + x);
+        }
+      }
+    }
+    stats.meanError = static_cast<float>(errorSum / fb.pixels.size());
+    stats.activePixels = static_cast<unsigned int>(active.size());
+    stats.seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    bool warmedUp =
+        stats.passes * settings.samplesPerPass >= settings.minSamples;
+    if (warmedUp && stats.meanError <= settings.targetNoise) {
+      break;
+    }
+    if (settings.timeBudget > 0.0 && stats.seconds >= settings.timeBudget) {
+      break;
+    }
+  }
+  return stats;
+}
+
+#endif
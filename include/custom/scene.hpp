@@ -0,0 +1,163 @@
+// Author: Kaan Eraslan
+
+// includes
+
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <custom/aliastable.hpp>
+#include <custom/envlight.hpp>
+#include <custom/light.hpp>
+#include <custom/lightbvh.hpp>
+#include <custom/scenetexture.hpp>
+#include <custom/sphere.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Material {
+  glm::vec3 albedo;
+  // index into Scene::textures multiplying albedo, -1 for none
+  int albedoTexture = -1;
+};
+
+// how a shading point picks the point lights it takes a shadow ray to
+enum LightSelection {
+  // every light, cheapest for a handful of them
+  LIGHTS_ALL,
+  // one light drawn from Scene::lightBvh
+  LIGHTS_BVH,
+  // one light drawn by power alone from Scene::lightPowers, constant time
+  // and cheap to update, for moderate numbers of lights
+  LIGHTS_POWER
+};
+
+// everything the integrator renders, flat arrays indexed by instance id
+struct Scene {
+  std::vector<Sphere> spheres;
+  // material of every sphere, only read when materials is not empty
+  std::vector<int> materialIds;
+  std::vector<Material> materials;
+  std::vector<SceneTexture> textures;
+  // one array per kind of light, see light.hpp
+  DirectionalLightArray directionalLights;
+  PointLightArray pointLights;
+  LightSelection lightSelection = LIGHTS_ALL;
+  /* Built by buildLightBvh and buildLightPowers. updateLights applies
+     changed colors and moved lights to them and rebuilds the selected one
+     when lights were added.
+   */
+  LightBvh lightBvh;
+  BlockedAliasTable lightPowers;
+  // sky gradient seen by rays that leave the scene
+  glm::vec3 skyBottom = glm::vec3(0.0f, 0.0f, 0.26f);
+  glm::vec3 skyTop = glm::vec3(1.0f, 1.0f, 0.26f);
+  // replaces the gradient and is sampled as a light when set
+  std::shared_ptr<const EnvironmentLight> environment;
+
+  int addSphere(glm::vec3 center, float radius, int materialId = 0);
+  int addMaterial(glm::vec3 albedo, int albedoTexture = -1);
+  int addTexture(SceneTexture texture);
+  /* Opens an image through TextureTileCache, -1 when it can not be read.
+     The first open of an image decodes all of it, see
+     TiledTexture::openImage
+   */
+  int loadTexture(const std::string &path);
+  // builds lightBvh and makes shading points sample it
+  void buildLightBvh();
+  // builds lightPowers and makes shading points sample it
+  void buildLightPowers();
+  /* Takes the colors changed and the lights moved since the last call
+     into the built structures. Moved lights refit lightBvh, or rebuild it
+     when more than a quarter of them moved.
+   */
+  void updateLights();
+  /* lightSelection when its structure covers every point light as they
+     are, otherwise LIGHTS_ALL: a structure built before lights were
+     added would never pick them, and one whose lights moved since the
+     last updateLights would weigh them by their old places
+   */
+  LightSelection getLightSelection() const;
+};
+
+inline int Scene::addSphere(glm::vec3 center, float radius, int materialId) {
+  Sphere s;
+  s.center = center;
+  s.radius = radius;
+  this->spheres.push_back(s);
+  this->materialIds.push_back(materialId);
+  return static_cast<int>(this->spheres.size()) - 1;
+}
+inline int Scene::addMaterial(glm::vec3 albedo, int albedoTexture) {
+  Material m;
+  m.albedo = albedo;
+  m.albedoTexture = albedoTexture;
+  this->materials.push_back(m);
+  return static_cast<int>(this->materials.size()) - 1;
+}
+inline void Scene::buildLightBvh() {
+  this->lightBvh.build(this->pointLights);
+  this->lightSelection = LIGHTS_BVH;
+}
+inline void Scene::buildLightPowers() {
+  std::vector<float> powers(this->pointLights.size());
+  for (std::size_t i = 0; i < powers.size(); i++) {
+    powers[i] = getLightPower(this->pointLights.getColor(i));
+  }
+  this->lightPowers.build(powers.data(), powers.size());
+  this->lightSelection = LIGHTS_POWER;
+}
+inline void Scene::updateLights() {
+  std::size_t count = this->pointLights.size();
+  std::vector<uint32_t> changes = this->pointLights.takeChanges();
+  std::vector<uint32_t> moves = this->pointLights.takeMoves();
+  if (this->lightSelection == LIGHTS_BVH &&
+      (this->lightBvh.getLightCount() != count || 4 * moves.size() > count)) {
+    this->buildLightBvh();
+  } else if (this->lightBvh.getLightCount() == count && count > 0) {
+    for (uint32_t i : changes) {
+      this->lightBvh.setPower(i, getLightPower(this->pointLights.getColor(i)));
+    }
+    for (uint32_t i : moves) {
+      this->lightBvh.setPosition(i, this->pointLights.getPosition(i));
+    }
+  }
+  if (this->lightSelection == LIGHTS_POWER &&
+      this->lightPowers.getCount() != count) {
+    this->buildLightPowers();
+  } else if (this->lightPowers.getCount() == count && count > 0) {
+    for (uint32_t i : changes) {
+      this->lightPowers.setWeight(
+          i, getLightPower(this->pointLights.getColor(i)));
+    }
+    this->lightPowers.refresh();
+  }
+}
+inline LightSelection Scene::getLightSelection() const {
+  std::size_t count = this->pointLights.size();
+  if (count == 0 ||
+      (this->lightSelection == LIGHTS_BVH &&
+       (this->lightBvh.getLightCount() != count ||
+        this->pointLights.hasMoves())) ||
+      (this->lightSelection == LIGHTS_POWER &&
+       this->lightPowers.getCount() != count)) {
+    return LIGHTS_ALL;
+  }
+  return this->lightSelection;
+}
+inline int Scene::addTexture(SceneTexture texture) {
+  this->textures.push_back(std::move(texture));
+  return static_cast<int>(this->textures.size()) - 1;
+}
+
+inline int Scene::loadTexture(const std::string &path) {
+  std::shared_ptr<const TiledTexture> texture =
+      TextureTileCache::getInstance().open(path);
+  if (!texture) {
+    return -1;
+  }
+  return this->addTexture(std::move(texture));
+}
+
+#endif
@@ -0,0 +1,53 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef SCENETEXTURE_HPP
+#define SCENETEXTURE_HPP
+
+#include <custom/texture.hpp>
+#include <custom/tiledtexture.hpp>
+
+#include <memory>
+
+/* Texture the scene samples, either resident or tiled.
+   A CpuTexture suits textures built in memory and small images, a
+   TiledTexture keeps large images on disk under the budget of the
+   TextureTileCache. Both filter the same way, so a lookup only adds a
+   well predicted branch over calling the texture directly.
+ */
+class SceneTexture {
+public:
+  SceneTexture() {}
+  SceneTexture(std::shared_ptr<const CpuTexture> texture)
+      : resident(std::move(texture)) {}
+  SceneTexture(std::shared_ptr<const TiledTexture> texture)
+      : tiled(std::move(texture)) {}
+
+  explicit operator bool() const { return this->resident || this->tiled; }
+  bool isTiled() const { return static_cast<bool>(this->tiled); }
+  int getWidth() const {
+    return this->resident ? this->resident->getWidth()
+           : this->tiled  ? this->tiled->getWidth()
+                          : 0;
+  }
+  int getHeight() const {
+    return this->resident ? this->resident->getHeight()
+           : this->tiled  ? this->tiled->getHeight()
+                          : 0;
+  }
+
+  glm::vec4 sampleDifferential(glm::vec2 uv, glm::vec2 duvdx,
+                               glm::vec2 duvdy) const {
+    if (this->resident) {
+      return this->resident->sampleDifferential(uv, duvdx, duvdy);
+    }
+    return this->tiled->sampleDifferential(uv, duvdx, duvdy);
+  }
+
+private:
+  std::shared_ptr<const CpuTexture> resident;
+  std::shared_ptr<const TiledTexture> tiled;
+};
+
+#endif
@@ -0,0 +1,253 @@
+// Author: Kaan Eraslan
+
+// includes
+
+#ifndef SPHERE_HPP
+#define SPHERE_HPP
+
+#include <custom/differential.hpp>
+#include <custom/lanes.hpp>
+#include <custom/ray.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// what the renderer needs to know about the closest intersection
+template <typename T> struct HitRecordT {
+  T t;
+  Vec3T<T> point;
+  Vec3T<T> normal;
+  int instanceId;
+};
+
+template <typename T> struct SphereT {
+  Vec3T<T> center;
+  T radius;
+
+  bool hit(const RayT<T> &ray, T tmin, T tmax, HitRecordT<T> &rec) const;
+  // fills rec for a hit at distance t along ray
+  void setHit(const RayT<T> &ray, T t, HitRecordT<T> &rec) const;
+  // only textured hits need the parameterization, hit does not compute it
+  SurfacePartialsT<T> getPartials(Vec3T<T> normal) const;
+};
+
+template <typename T>
+bool SphereT<T>::hit(const RayT<T> &ray, T tmin, T tmax,
+                     HitRecordT<T> &rec) const {
+  // solve |o + t d - c|^2 = r^2 with the half b form of the quadratic
+  Vec3T<T> oc = ray.origin - this->center;
+  T a = glm::dot(ray.direction, ray.direction);
+  T halfB = glm::dot(oc, ray.direction);
+  T c = glm::dot(oc, oc) - this->radius * this->radius;
+  T discriminant = halfB * halfB - a * c;
+  if (discriminant < T(0)) {
+    return false;
+  }
+  T root = std::sqrt(discriminant);
+  T t = (-halfB - root) / a;
+  if (t <= tmin || t >= tmax) {
+    t = (-halfB + root) / a;
+    if (t <= tmin || t >= tmax) {
+      return false;
+    }
+  }
+  this->setHit(ray, t, rec);
+  return true;
+}
+
+template <typename T>
+void SphereT<T>::setHit(const RayT<T> &ray, T t, HitRecordT<T> &rec) const {
+  rec.t = t;
+  rec.point = ray.at(t);
+  rec.normal = (rec.point - this->center) / this->radius;
+}
+
+template <typename T>
+SurfacePartialsT<T> SphereT<T>::getPartials(Vec3T<T> normal) const {
+  /* u goes around the y axis and v from the bottom pole to the top one,
+     n = (-cos(phi) sin(theta), -cos(theta), sin(phi) sin(theta)) with
+     phi = 2 pi u and theta = pi v. The partials are written with n so no
+     trigonometry is needed after the atan2 and acos of the uv.
+   */
+  SurfacePartialsT<T> s;
+  T pi = glm::pi<T>();
+  T ny = std::min(std::max(normal.y, T(-1)), T(1));
+  s.uv.x = (std::atan2(-normal.z, normal.x) + pi) / (T(2) * pi);
+  s.uv.y = std::acos(-ny) / pi;
+  // sin(theta), kept away from zero at the poles
+  T sinTheta = std::max(std::sqrt(normal.x * normal.x + normal.z * normal.z),
+                        T(1.0e-6));
+  s.dndu = T(2) * pi * Vec3T<T>(normal.z, T(0), -normal.x);
+  s.dndv = pi * Vec3T<T>(-normal.x * ny / sinTheta, sinTheta,
+                         -normal.z * ny / sinTheta);
+  s.dpdu = this->radius * s.dndu;
+  s.dpdv = this->radius * s.dndv;
+  return s;
+}
+
+/* Spheres with every field in its own array, tested against a ray
+   LanesT<T>::width spheres at a time: four in float, two in double. The
+   lanes do the arithmetic of SphereT::hit in the same order, so the
+   distances are those of the scalar test and ties go to the lower index
+   as in a scalar loop.
+ */
+template <typename T> class SphereArrayT {
+public:
+  void push_back(const SphereT<T> &sphere);
+  std::size_t size() const { return this->radius2.size(); }
+
+  // closest sphere hit in (tmin, tmax) and its distance t, -1 for none
+  int hitClosest(const RayT<T> &ray, T tmin, T tmax, T &t) const;
+  bool hitAny(const RayT<T> &ray, T tmin, T tmax) const;
+
+private:
+  std::vector<T> centerX;
+  std::vector<T> centerY;
+  std::vector<T> centerZ;
+  std::vector<T> radius2;
+
+  // distance to sphere i in (tmin, tmax), infinity for a miss
+  T getDistance(std::size_t i, const RayT<T> &ray, T a, T tmin,
+                T tmax) const;
+  template <typename Visit>
+  void visitLanes(const RayT<T> &ray, T tmin, T &tmax, std::size_t &i,
+                  Visit visit) const;
+};
+
+template <typename T>
+void SphereArrayT<T>::push_back(const SphereT<T> &sphere) {
+  this->centerX.push_back(sphere.center.x);
+  this->centerY.push_back(sphere.center.y);
+  this->centerZ.push_back(sphere.center.z);
+  this->radius2.push_back(sphere.radius * sphere.radius);
+}
+
+template <typename T>
+T SphereArrayT<T>::getDistance(std::size_t i, const RayT<T> &ray, T a,
+                               T tmin, T tmax) const {
+  T ocx = ray.origin.x - this->centerX[i];
+  T ocy = ray.origin.y - this->centerY[i];
+  T ocz = ray.origin.z - this->centerZ[i];
+  T halfB = ocx * ray.direction.x + ocy * ray.direction.y +
+            ocz * ray.direction.z;
+  T c = ocx * ocx + ocy * ocy + ocz * ocz - this->radius2[i];
+  T discriminant = halfB * halfB - a * c;
+  if (!(discriminant >= T(0))) {
+    return T(INFINITY);
+  }
+  T root = std::sqrt(discriminant);
+  T t = (T(0) - halfB - root) / a;
+  if (t > tmin && t < tmax) {
+    return t;
+  }
+  t = (T(0) - halfB + root) / a;
+  return t > tmin && t < tmax ? t : T(INFINITY);
+}
+
+template <typename T>
+template <typename Visit>
+void SphereArrayT<T>::visitLanes(const RayT<T> &ray, T tmin, T &tmax,
+                                 std::size_t &i, Visit visit) const {
+  /* Runs the packs of spheres, calls visit with the distances of a pack
+     that has a hit below tmax and stops when it returns true. i is left at
+     the first sphere not tested.
+   */
+  using L = LanesT<T>;
+  if constexpr (L::width > 1) {
+    using V = typename L::V;
+    const std::size_t n = this->size();
+    const V ox = L::set(ray.origin.x), oy = L::set(ray.origin.y),
+            oz = L::set(ray.origin.z), dx = L::set(ray.direction.x),
+            dy = L::set(ray.direction.y), dz = L::set(ray.direction.z),
+            a = L::set(glm::dot(ray.direction, ray.direction)),
+            tminV = L::set(tmin), zero = L::set(T(0)),
+            miss = L::set(T(INFINITY));
+    V tmaxV = L::set(tmax);
+    for (; i + L::width <= n; i += L::width) {
+      V ocx = L::sub(ox, L::load(&this->centerX[i]));
+      V ocy = L::sub(oy, L::load(&this->centerY[i]));
+      V ocz = L::sub(oz, L::load(&this->centerZ[i]));
+      V halfB = L::add(L::add(L::mul(ocx, dx), L::mul(ocy, dy)),
+                       L::mul(ocz, dz));
+      V c = L::sub(L::add(L::add(L::mul(ocx, ocx), L::mul(ocy, ocy)),
+                          L::mul(ocz, ocz)),
+                   L::load(&this->radius2[i]));
+      V discriminant = L::sub(L::mul(halfB, halfB), L::mul(a, c));
+      V crosses = L::ge(discriminant, zero);
+      if (L::bits(crosses) == 0) {
+        continue;
+      }
+      // lanes that miss take the sqrt of a negative, the mask drops them
+      V root = L::sqrt(discriminant);
+      V negB = L::sub(zero, halfB);
+      V near = L::div(L::sub(negB, root), a);
+      V far = L::div(L::add(negB, root), a);
+      V nearOk = L::andMask(crosses, L::andMask(L::gt(near, tminV),
+                                                L::lt(near, tmaxV)));
+      V farOk = L::andMask(crosses, L::andMask(L::gt(far, tminV),
+                                               L::lt(far, tmaxV)));
+      V t = L::select(nearOk, near, L::select(farOk, far, miss));
+      if (L::bits(L::lt(t, tmaxV)) == 0) {
+        continue;
+      }
+      T lanes[L::width];
+      L::store(lanes, t);
+      if (visit(lanes)) {
+        i += L::width;
+        return;
+      }
+      tmaxV = L::set(tmax);
+    }
+  }
+}
+
+template <typename T>
+int SphereArrayT<T>::hitClosest(const RayT<T> &ray, T tmin, T tmax,
+                                T &t) const {
+  int closest = -1;
+  std::size_t i = 0;
+  this->visitLanes(ray, tmin, tmax, i, [&](const T *lanes) {
+    for (int k = 0; k < LanesT<T>::width; k++) {
+      if (lanes[k] < tmax) {
+        tmax = lanes[k];
+        closest = static_cast<int>(i) + k;
+      }
+    }
+    return false;
+  });
+  T a = glm::dot(ray.direction, ray.direction);
+  for (; i < this->size(); i++) {
+    T d = this->getDistance(i, ray, a, tmin, tmax);
+    if (d < tmax) {
+      tmax = d;
+      closest = static_cast<int>(i);
+    }
+  }
+  t = tmax;
+  return closest;
+}
+
+template <typename T>
+bool SphereArrayT<T>::hitAny(const RayT<T> &ray, T tmin, T tmax) const {
+  bool hit = false;
+  std::size_t i = 0;
+  this->visitLanes(ray, tmin, tmax, i, [&](const T *) { return hit = true; });
+  if (hit) {
+    return true;
+  }
+  T a = glm::dot(ray.direction, ray.direction);
+  for (; i < this->size(); i++) {
+    if (this->getDistance(i, ray, a, tmin, tmax) < tmax) {
+      return true;
+    }
+  }
+  return false;
+}
+
+using HitRecord = HitRecordT<float>;
+using Sphere = SphereT<float>;
+
+#endif
@@ -0,0 +1,138 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef TANGENTS_HPP
+#define TANGENTS_HPP
+
+#include <assimp/mesh.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+/* Tangent frames of a mesh for normal mapping.
+   Assimp computes them for every mesh with aiProcess_CalcTangentSpace,
+   while only meshes whose material has a normal map read them. The model
+   loaders import without that flag and call this for those meshes only,
+   from the pass that converts the meshes in parallel.
+   Like assimp the face tangents are averaged over the vertices sharing a
+   position and a normal, so the triangulated copies of one vertex get
+   the same frame and still weld. The frames are orthonormal to the normal,
+   the bitangent keeps the handedness of the uv mapping.
+ */
+inline uint64_t hashVertexKey(const aiVector3D &p, const aiVector3D &n) {
+  float values[6] = {p.x, p.y, p.z, n.x, n.y, n.z};
+  uint64_t h = 1469598103934665603ull;
+  for (float v : values) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    h = (h ^ bits) * 1099511628211ull;
+  }
+  return h;
+}
+
+inline glm::vec3 getPerpendicular(glm::vec3 n) {
+  // any unit vector orthogonal to n
+  glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                        : glm::vec3(0.0f, 1.0f, 0.0f);
+  return glm::normalize(glm::cross(n, axis));
+}
+
+inline bool computeTangentFrames(const aiMesh *mesh, glm::vec3 *tangents,
+                                 glm::vec3 *bitangents) {
+  // false when the mesh has no normals or uvs to derive frames from
+  const unsigned int n = mesh->mNumVertices;
+  const aiVector3D *uvs = mesh->mTextureCoords[0];
+  if (!mesh->mNormals || !uvs) {
+    return false;
+  }
+
+  // vertices with the same position and normal share a group
+  std::unordered_map<uint64_t, unsigned int> heads;
+  heads.reserve(n);
+  std::vector<unsigned int> next;
+  std::vector<unsigned int> first;
+  std::vector<unsigned int> group(n);
+  const unsigned int END = ~0u;
+  for (unsigned int v = 0; v < n; v++) {
+    const aiVector3D &p = mesh->mVertices[v];
+    const aiVector3D &nv = mesh->mNormals[v];
+    auto slot = heads.emplace(hashVertexKey(p, nv), END).first;
+    unsigned int g = slot->second;
+    while (g != END && !(mesh->mVertices[first[g]] == p &&
+                         mesh->mNormals[first[g]] == nv)) {
+      g = next[g];
+    }
+    if (g == END) {
+      g = static_cast<unsigned int>(first.size());
+      first.push_back(v);
+      next.push_back(slot->second);
+      slot->second = g;
+    }
+    group[v] = g;
+  }
+
+  std::vector<glm::vec3> sumT(first.size(), glm::vec3(0.0f));
+  std::vector<glm::vec3> sumB(first.size(), glm::vec3(0.0f));
+  for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+    const aiFace &face = mesh->mFaces[f];
+    if (face.mNumIndices != 3) {
+      continue;
+    }
+    unsigned int i0 = face.mIndices[0], i1 = face.mIndices[1],
+                 i2 = face.mIndices[2];
+    const aiVector3D e1 = mesh->mVertices[i1] - mesh->mVertices[i0];
+    const aiVector3D e2 = mesh->mVertices[i2] - mesh->mVertices[i0];
+    float du1 = uvs[i1].x - uvs[i0].x, dv1 = uvs[i1].y - uvs[i0].y;
+    float du2 = uvs[i2].x - uvs[i0].x, dv2 = uvs[i2].y - uvs[i0].y;
+    float det = du1 * dv2 - du2 * dv1;
+    if (std::abs(det) < 1.0e-12f) {
+      // the uvs of the face are degenerate, it gives no direction
+      continue;
+    }
+    float r = 1.0f / det;
+    glm::vec3 t = glm::vec3(e1.x * dv2 - e2.x * dv1, e1.y * dv2 - e2.y * dv1,
+                            e1.z * dv2 - e2.z * dv1) *
+                  r;
+    glm::vec3 b = glm::vec3(e2.x * du1 - e1.x * du2, e2.y * du1 - e1.y * du2,
+                            e2.z * du1 - e1.z * du2) *
+                  r;
+    // every face counts the same, as in assimp
+    float lt = glm::length(t), lb = glm::length(b);
+    if (lt > 0.0f) {
+      t /= lt;
+    }
+    if (lb > 0.0f) {
+      b /= lb;
+    }
+    for (unsigned int k = 0; k < 3; k++) {
+      sumT[group[face.mIndices[k]]] += t;
+      sumB[group[face.mIndices[k]]] += b;
+    }
+  }
+
+  for (unsigned int v = 0; v < n; v++) {
+    const aiVector3D &nv = mesh->mNormals[v];
+    glm::vec3 normal(nv.x, nv.y, nv.z);
+    float ln = glm::length(normal);
+    normal = ln > 0.0f ? normal / ln : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 t = sumT[group[v]];
+    t -= normal * glm::dot(normal, t);
+    float lt = glm::length(t);
+    t = lt > 1.0e-6f ? t / lt : getPerpendicular(normal);
+    glm::vec3 b = sumB[group[v]];
+    b -= normal * glm::dot(normal, b) + t * glm::dot(t, b);
+    float lb = glm::length(b);
+    b = lb > 1.0e-6f ? b / lb : glm::cross(normal, t);
+    tangents[v] = t;
+    bitangents[v] = b;
+  }
+  return true;
+}
+
+#endif
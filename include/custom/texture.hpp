@@ -0,0 +1,416 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <custom/imagedecode.hpp>
+#include <custom/parallel.hpp>
+#include <custom/texturecache.hpp>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+// texels are stored in square tiles of TEXTURE_TILE x TEXTURE_TILE
+const int TEXTURE_TILE_SHIFT = 3;
+const int TEXTURE_TILE = 1 << TEXTURE_TILE_SHIFT;
+const int TEXTURE_TILE_TEXELS = TEXTURE_TILE * TEXTURE_TILE;
+// tiles are grouped in blocks of up to 8x8 tiles, a block is the unit a
+// texture is paged in by
+const int TEXTURE_BLOCK_SHIFT = 3;
+// blocks start on a 4 KB page, in texels
+const uint64_t TEXTURE_BLOCK_ALIGNMENT = 1024;
+
+inline uint32_t spreadTileBits(uint32_t v) {
+  // 3 low bits of v moved to the even bits
+  v = (v | (v << 2)) & 0x33u;
+  return (v | (v << 1)) & 0x55u;
+}
+
+inline uint32_t packTexel(const unsigned char *pixel, int nrComponents) {
+  // every texel is rgba8, grey images are spread to rgb
+  uint32_t r, g, b, a = 255;
+  switch (nrComponents) {
+  case 1:
+    r = g = b = pixel[0];
+    break;
+  case 2:
+    r = g = b = pixel[0];
+    a = pixel[1];
+    break;
+  case 3:
+    r = pixel[0];
+    g = pixel[1];
+    b = pixel[2];
+    break;
+  default:
+    r = pixel[0];
+    g = pixel[1];
+    b = pixel[2];
+    a = pixel[3];
+    break;
+  }
+  return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+inline int getBlockShift(int tiles) {
+  // log2 of the tiles per block side, small levels get narrow blocks
+  int shift = 0;
+  while (shift < TEXTURE_BLOCK_SHIFT && (1 << shift) < tiles) {
+    shift++;
+  }
+  return shift;
+}
+
+/* Layout of one mip level in the texel array of its texture.
+   The level is cut into blocks stored row by row, a block holds its
+   tiles row by row and a tile its texels in Morton order. Plain data, it
+   is written to tile files as is.
+ */
+struct TextureLevel {
+  int32_t width = 0;
+  int32_t height = 0;
+  int32_t blocksX = 0;
+  int32_t blocksY = 0;
+  // log2 of the tiles per block side
+  int32_t blockShiftX = 0;
+  int32_t blockShiftY = 0;
+  // texels from one block to the next, padding included
+  uint64_t blockStride = 0;
+  // first texel of the level in the array
+  uint64_t first = 0;
+
+  void setSize(int w, int h) {
+    int tilesX = (w + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+    int tilesY = (h + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+    this->width = w;
+    this->height = h;
+    this->blockShiftX = getBlockShift(tilesX);
+    this->blockShiftY = getBlockShift(tilesY);
+    this->blocksX = (tilesX + (1 << this->blockShiftX) - 1) >> blockShiftX;
+    this->blocksY = (tilesY + (1 << this->blockShiftY) - 1) >> blockShiftY;
+    uint64_t blockTexels = uint64_t(TEXTURE_TILE_TEXELS)
+                           << (this->blockShiftX + this->blockShiftY);
+    this->blockStride = (blockTexels + TEXTURE_BLOCK_ALIGNMENT - 1) /
+                        TEXTURE_BLOCK_ALIGNMENT * TEXTURE_BLOCK_ALIGNMENT;
+  }
+  uint64_t getTexelCount() const {
+    return uint64_t(this->blocksX) * this->blocksY * this->blockStride;
+  }
+  uint32_t getBlockCount() const {
+    return static_cast<uint32_t>(this->blocksX * this->blocksY);
+  }
+  uint32_t getBlock(int x, int y) const {
+    return static_cast<uint32_t>(
+        (y >> (TEXTURE_TILE_SHIFT + this->blockShiftY)) * this->blocksX +
+        (x >> (TEXTURE_TILE_SHIFT + this->blockShiftX)));
+  }
+
+  /* The address of a texel is the sum of a part that only depends on x
+     and one that only depends on y, so a bilinear lookup computes two of
+     each instead of four full addresses.
+   */
+  uint64_t getColumnOffset(int x) const {
+    int tile = x >> TEXTURE_TILE_SHIFT;
+    return uint64_t(tile >> this->blockShiftX) * this->blockStride +
+           uint64_t(tile & ((1 << this->blockShiftX) - 1)) *
+               TEXTURE_TILE_TEXELS +
+           spreadTileBits(x & (TEXTURE_TILE - 1));
+  }
+  uint64_t getRowOffset(int y) const {
+    int tile = y >> TEXTURE_TILE_SHIFT;
+    return this->first +
+           uint64_t(tile >> this->blockShiftY) * this->blocksX *
+               this->blockStride +
+           (uint64_t(tile & ((1 << this->blockShiftY) - 1)) *
+            TEXTURE_TILE_TEXELS << this->blockShiftX) +
+           (spreadTileBits(y & (TEXTURE_TILE - 1)) << 1);
+  }
+};
+
+// lays out the levels of a width x height texture, returns the texel count
+inline uint64_t layoutTextureLevels(int width, int height,
+                                    std::vector<TextureLevel> &levels) {
+  levels.clear();
+  uint64_t count = 0;
+  for (int w = width, h = height;; w = std::max(w >> 1, 1),
+           h = std::max(h >> 1, 1)) {
+    TextureLevel level;
+    level.setSize(w, h);
+    level.first = count;
+    count += level.getTexelCount();
+    levels.push_back(level);
+    if (w == 1 && h == 1) {
+      break;
+    }
+  }
+  return count;
+}
+
+inline int wrapTexel(int x, int size) {
+  // repeat, also for negative coordinates; most lookups are inside
+  if (static_cast<unsigned int>(x) < static_cast<unsigned int>(size)) {
+    return x;
+  }
+  x %= size;
+  return x < 0 ? x + size : x;
+}
+
+inline glm::vec4 filterBilinear(uint32_t t00, uint32_t t10, uint32_t t01,
+                                uint32_t t11, float fx, float fy) {
+  // blend four rgba8 texels, weights sum to one
+  float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy);
+  float w01 = (1.0f - fx) * fy, w11 = fx * fy;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  auto unpack = [&](uint32_t t) {
+    __m128i v = _mm_cvtsi32_si128(static_cast<int>(t));
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+    return _mm_cvtepi32_ps(v);
+  };
+  __m128 sum = _mm_mul_ps(unpack(t00), _mm_set1_ps(w00));
+  sum = _mm_add_ps(sum, _mm_mul_ps(unpack(t10), _mm_set1_ps(w10)));
+  sum = _mm_add_ps(sum, _mm_mul_ps(unpack(t01), _mm_set1_ps(w01)));
+  sum = _mm_add_ps(sum, _mm_mul_ps(unpack(t11), _mm_set1_ps(w11)));
+  sum = _mm_mul_ps(sum, _mm_set1_ps(1.0f / 255.0f));
+  glm::vec4 result;
+  _mm_storeu_ps(&result.x, sum);
+  return result;
+#else
+  auto unpack = [](uint32_t t) {
+    return glm::vec4(float(t & 255u), float((t >> 8) & 255u),
+                     float((t >> 16) & 255u), float(t >> 24));
+  };
+  return (unpack(t00) * w00 + unpack(t10) * w10 + unpack(t01) * w01 +
+          unpack(t11) * w11) *
+         (1.0f / 255.0f);
+#endif
+}
+
+template <typename Texture>
+glm::vec4 sampleTextureBilinear(const Texture &texture, glm::vec2 uv, int l) {
+  /* Bilinear lookup shared by every texture type. The texture gives its
+     level layouts and getTexels(level, x0, y0, x1, y1), which returns the
+     texel array once the texels of the quad can be read.
+   */
+  if (texture.getLevelCount() == 0) {
+    return glm::vec4(0.0f);
+  }
+  l = std::min(std::max(l, 0), texture.getLevelCount() - 1);
+  const TextureLevel &level = texture.getLevel(l);
+  float x = uv.x * level.width - 0.5f;
+  float y = uv.y * level.height - 0.5f;
+  float fx = std::floor(x), fy = std::floor(y);
+  int x0 = wrapTexel(static_cast<int>(fx), level.width);
+  int y0 = wrapTexel(static_cast<int>(fy), level.height);
+  int x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+  int y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+  uint64_t c0 = level.getColumnOffset(x0), c1 = level.getColumnOffset(x1);
+  uint64_t r0 = level.getRowOffset(y0), r1 = level.getRowOffset(y1);
+  const uint32_t *t = texture.getTexels(l, x0, y0, x1, y1);
+  return filterBilinear(t[c0 + r0], t[c1 + r0], t[c0 + r1], t[c1 + r1],
+                        x - fx, y - fy);
+}
+
+template <typename Texture>
+glm::vec4 sampleTextureTrilinear(const Texture &texture, glm::vec2 uv,
+                                 float lod) {
+  float maxLevel = static_cast<float>(texture.getLevelCount() - 1);
+  lod = std::min(std::max(lod, 0.0f), std::max(maxLevel, 0.0f));
+  int l0 = static_cast<int>(lod);
+  float t = lod - static_cast<float>(l0);
+  glm::vec4 a = sampleTextureBilinear(texture, uv, l0);
+  if (t == 0.0f) {
+    return a;
+  }
+  return a + (sampleTextureBilinear(texture, uv, l0 + 1) - a) * t;
+}
+
+template <typename Texture>
+float getTextureLod(const Texture &texture, glm::vec2 duvdx, glm::vec2 duvdy) {
+  // mip level whose texels are as wide as the longer side of the pixel
+  // footprint, given as the change of uv over one pixel in x and in y
+  if (texture.getLevelCount() == 0) {
+    return 0.0f;
+  }
+  glm::vec2 size(static_cast<float>(texture.getLevel(0).width),
+                 static_cast<float>(texture.getLevel(0).height));
+  float width = std::max(glm::length(duvdx * size), glm::length(duvdy * size));
+  return width > 1.0f ? std::log2(width) : 0.0f;
+}
+
+template <typename Texture>
+glm::vec4 sampleTextureDifferential(const Texture &texture, glm::vec2 uv,
+                                    glm::vec2 duvdx, glm::vec2 duvdy) {
+  return sampleTextureTrilinear(texture, uv,
+                                getTextureLod(texture, duvdx, duvdy));
+}
+
+/* Texture sampled by the ray tracer on the cpu.
+   The mip chain is built at load with a box filter, each level in
+   parallel over its rows of blocks. Texels of a level are grouped in 8x8
+   tiles of 256 bytes with Morton order inside a tile, so the four texels
+   of a bilinear lookup and the lookups of neighbouring rays mostly land
+   in the same few cache lines. Coordinates wrap like GL_REPEAT. Filtering
+   works on four channels at once, with sse2 where it is available.
+ */
+class CpuTexture {
+public:
+  CpuTexture() {}
+
+  // pixels are rows of nrComponents bytes, as stb image returns them
+  bool build(const unsigned char *pixels, int width, int height,
+             int nrComponents, unsigned int threadCount = 0);
+
+  int getWidth() const { return this->levels.empty() ? 0 : levels[0].width; }
+  int getHeight() const {
+    return this->levels.empty() ? 0 : levels[0].height;
+  }
+  int getLevelCount() const { return static_cast<int>(this->levels.size()); }
+  const TextureLevel &getLevel(int level) const { return levels[level]; }
+  const std::vector<TextureLevel> &getLevels() const { return this->levels; }
+  const std::vector<uint32_t> &getTexelArray() const { return this->texels; }
+  std::size_t getMemorySize() const {
+    return this->texels.size() * sizeof(uint32_t);
+  }
+  // every texel is in memory
+  const uint32_t *getTexels(int, int, int, int, int) const {
+    return this->texels.data();
+  }
+
+  // texel centers are at half integers, result channels in [0, 1]
+  glm::vec4 sampleBilinear(glm::vec2 uv, int level = 0) const {
+    return sampleTextureBilinear(*this, uv, level);
+  }
+  // lod is the mip level, fractional levels blend two of them
+  glm::vec4 sampleTrilinear(glm::vec2 uv, float lod) const {
+    return sampleTextureTrilinear(*this, uv, lod);
+  }
+  // lod from the uv footprint of a pixel, see RayDifferentialT
+  glm::vec4 sampleDifferential(glm::vec2 uv, glm::vec2 duvdx,
+                               glm::vec2 duvdy) const {
+    return sampleTextureDifferential(*this, uv, duvdx, duvdy);
+  }
+
+private:
+  std::vector<TextureLevel> levels;
+  std::vector<uint32_t> texels;
+
+  void buildLevel(int level, unsigned int threadCount);
+};
+
+inline bool CpuTexture::build(const unsigned char *pixels, int width,
+                              int height, int nrComponents,
+                              unsigned int threadCount) {
+  this->levels.clear();
+  this->texels.clear();
+  if (!pixels || width <= 0 || height <= 0 || nrComponents < 1 ||
+      nrComponents > 4) {
+    return false;
+  }
+  this->texels.resize(layoutTextureLevels(width, height, this->levels));
+
+  // level 0 is swizzled into tiles, one row of tiles per task; texels of
+  // a tile past the image edge repeat the edge
+  const TextureLevel &base = this->levels[0];
+  int tilesX = (width + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+  int tilesY = (height + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+  parallelFor(
+      0, tilesY,
+      [&](std::size_t ty) {
+        for (int j = 0; j < TEXTURE_TILE; j++) {
+          int ly = static_cast<int>(ty) * TEXTURE_TILE + j;
+          int y = std::min(ly, height - 1);
+          uint64_t row = base.getRowOffset(ly);
+          for (int lx = 0; lx < tilesX * TEXTURE_TILE; lx++) {
+            int x = std::min(lx, width - 1);
+            this->texels[row + base.getColumnOffset(lx)] = packTexel(
+                pixels +
+                    (static_cast<std::size_t>(y) * width + x) * nrComponents,
+                nrComponents);
+          }
+        }
+      },
+      threadCount, 1);
+
+  // every level only reads the one above it
+  for (int l = 1; l < this->getLevelCount(); l++) {
+    this->buildLevel(l, threadCount);
+  }
+  return true;
+}
+
+inline void CpuTexture::buildLevel(int l, unsigned int threadCount) {
+  const TextureLevel &src = this->levels[l - 1];
+  const TextureLevel &dst = this->levels[l];
+  int tilesX = (dst.width + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+  int tilesY = (dst.height + TEXTURE_TILE - 1) >> TEXTURE_TILE_SHIFT;
+  const uint32_t *in = this->texels.data();
+  parallelFor(
+      0, tilesY,
+      [&](std::size_t ty) {
+        for (int j = 0; j < TEXTURE_TILE; j++) {
+          int ly = static_cast<int>(ty) * TEXTURE_TILE + j;
+          int y = std::min(ly, dst.height - 1);
+          uint64_t row0 = src.getRowOffset(std::min(2 * y, src.height - 1));
+          uint64_t row1 =
+              src.getRowOffset(std::min(2 * y + 1, src.height - 1));
+          uint64_t row = dst.getRowOffset(ly);
+          for (int lx = 0; lx < tilesX * TEXTURE_TILE; lx++) {
+            int x = std::min(lx, dst.width - 1);
+            uint64_t col0 = src.getColumnOffset(std::min(2 * x, src.width - 1));
+            uint64_t col1 =
+                src.getColumnOffset(std::min(2 * x + 1, src.width - 1));
+            uint32_t a = in[row0 + col0], b = in[row0 + col1];
+            uint32_t c = in[row1 + col0], d = in[row1 + col1];
+            uint32_t texel = 0;
+            for (int k = 0; k < 32; k += 8) {
+              uint32_t sum = ((a >> k) & 255u) + ((b >> k) & 255u) +
+                             ((c >> k) & 255u) + ((d >> k) & 255u);
+              texel |= ((sum + 2) >> 2) << k;
+            }
+            this->texels[row + dst.getColumnOffset(lx)] = texel;
+          }
+        }
+      },
+      threadCount, 1);
+}
+
+using CpuTextureCache = TextureCacheT<std::shared_ptr<const CpuTexture>>;
+
+inline CpuTextureCache::Future
+requestCpuTexture(const std::string &path, const std::string &directory) {
+  // same as requestTextureFromFile of Model, the worker also builds the
+  // mip chain so nothing is left for the render threads. The whole
+  // pyramid stays in memory, Scene::loadTexture pages images in instead
+  return CpuTextureCache::getInstance().request(
+      directory + '/' + path,
+      [](const unsigned char *bytes, std::size_t size,
+         std::shared_ptr<const CpuTexture> &texture) {
+        int width, height, nrComponents;
+        unsigned char *pixels =
+            decodeImage(bytes, size, width, height, nrComponents);
+        if (!pixels) {
+          return false;
+        }
+        std::shared_ptr<CpuTexture> built = std::make_shared<CpuTexture>();
+        bool ok = built->build(pixels, width, height, nrComponents);
+        std::free(pixels);
+        texture = built;
+        return ok;
+      });
+}
+
+#endif
@@ -0,0 +1,189 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef TEXTURECACHE_HPP
+#define TEXTURECACHE_HPP
+
+#include <custom/mappedfile.hpp>
+#include <custom/parallel.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 64 bit fnv-1a, used to recognize identical image files
+inline uint64_t hashBytes(const unsigned char *data, std::size_t size) {
+  uint64_t h = 14695981039346656037ull;
+  for (std::size_t i = 0; i < size; i++) {
+    h ^= data[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+struct TextureCacheStats {
+  // lookups answered by the path index, by the content index and loads
+  unsigned long pathHits = 0;
+  unsigned long contentHits = 0;
+  unsigned long loads = 0;
+  // files that could not be read or decoded
+  unsigned long failures = 0;
+};
+
+// outcome of a texture request, handle is only set when loaded is true
+template <typename Handle> struct TextureLoadT {
+  bool loaded = false;
+  Handle handle = Handle();
+};
+
+/* Process wide texture cache.
+   Textures are found by canonical path first, which costs a hash lookup.
+   A path seen for the first time is mapped and its bytes are hashed, so the
+   same image reached through another path or copied to another directory
+   is still decoded once. Handle is whatever the caller keeps per texture,
+   a decoded image for Model.
+   Reading and decoding run on the worker pool: request returns at once
+   with a future, so the caller can queue every texture of a model and
+   keep converting geometry while they decode. A failed load is remembered
+   until clear, like a successful one.
+ */
+template <typename Handle> class TextureCacheT {
+public:
+  using Load = TextureLoadT<Handle>;
+  using Future = std::shared_future<Load>;
+
+  static TextureCacheT &getInstance();
+
+  // loader(bytes, size, handle) decodes the file on a worker thread, it
+  // returns false on failure. bytes point into a mapping of the file that
+  // is closed when loader returns
+  template <typename Loader>
+  Future request(const std::string &path, Loader loader);
+  // request and wait
+  template <typename Loader>
+  bool get(const std::string &path, Loader loader, Handle &handle);
+  TextureCacheStats getStats();
+  void clear();
+
+private:
+  struct ContentEntry {
+    std::size_t size;
+    Future result;
+  };
+  std::mutex mutex;
+  std::unordered_map<std::string, Future> byPath;
+  std::unordered_map<uint64_t, ContentEntry> byContent;
+  TextureCacheStats stats;
+
+  template <typename Loader>
+  Load load(const std::string &key, Loader &loader, const Future &self);
+};
+
+template <typename Handle>
+TextureCacheT<Handle> &TextureCacheT<Handle>::getInstance() {
+  static TextureCacheT<Handle> cache;
+  return cache;
+}
+
+template <typename Handle>
+template <typename Loader>
+typename TextureCacheT<Handle>::Future
+TextureCacheT<Handle>::request(const std::string &path, Loader loader) {
+  std::error_code err;
+  std::string key = std::filesystem::weakly_canonical(path, err).string();
+  if (err) {
+    key = path;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto pathIt = this->byPath.find(key);
+  if (pathIt != this->byPath.end()) {
+    this->stats.pathHits++;
+    return pathIt->second;
+  }
+  // the future is registered before the task is queued, a second request
+  // for the same path waits on it instead of decoding again
+  auto promise = std::make_shared<std::promise<Load>>();
+  Future result = promise->get_future().share();
+  this->byPath[key] = result;
+  ThreadPool::getInstance().submit([this, key, loader, promise, result]() {
+    Loader decode = loader;
+    promise->set_value(this->load(key, decode, result));
+  });
+  return result;
+}
+
+template <typename Handle>
+template <typename Loader>
+typename TextureCacheT<Handle>::Load
+TextureCacheT<Handle>::load(const std::string &key, Loader &loader,
+                            const Future &self) {
+  // runs on a worker, the lock is only held around the index updates
+  // the file is mapped instead of read, the decoder works on the page
+  // cache directly
+  MappedFile file;
+  if (!file.open(key)) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.failures++;
+    return Load();
+  }
+  file.willNeed(0, file.size());
+  uint64_t hash = hashBytes(file.data(), file.size());
+  Future same;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto contentIt = this->byContent.find(hash);
+    if (contentIt == this->byContent.end()) {
+      this->byContent[hash] = ContentEntry{file.size(), self};
+    } else if (contentIt->second.size == file.size()) {
+      this->stats.contentHits++;
+      same = contentIt->second.result;
+    }
+  }
+  if (same.valid()) {
+    // the entry was added by a task that is already running, waiting on
+    // it can not starve the pool
+    return same.get();
+  }
+
+  Load result;
+  result.loaded = loader(file.data(), file.size(), result.handle);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (result.loaded) {
+    this->stats.loads++;
+  } else {
+    this->stats.failures++;
+  }
+  return result;
+}
+
+template <typename Handle>
+template <typename Loader>
+bool TextureCacheT<Handle>::get(const std::string &path, Loader loader,
+                                Handle &handle) {
+  Load result = this->request(path, loader).get();
+  if (result.loaded) {
+    handle = result.handle;
+  }
+  return result.loaded;
+}
+
+template <typename Handle> TextureCacheStats TextureCacheT<Handle>::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
+
+template <typename Handle> void TextureCacheT<Handle>::clear() {
+  // forgets the handles, releasing them is up to the owner; loads still in
+  // flight complete into the futures their callers hold
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->byPath.clear();
+  this->byContent.clear();
+  this->stats = TextureCacheStats();
+}
+
+#endif
@@ -0,0 +1,544 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef TILEDTEXTURE_HPP
+#define TILEDTEXTURE_HPP
+
+#include <custom/mappedfile.hpp>
+#include <custom/meshcache.hpp>
+#include <custom/texture.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint32_t TEXTURE_TILES_MAGIC = 0x54544949u; // "IITT"
+const uint32_t TEXTURE_TILES_VERSION = 1;
+// texels start on a page, blocks are page multiples after that
+const uint64_t TEXTURE_TILES_ALIGNMENT = 4096;
+
+/* A tile file is the header, the level table and the texel array of a
+   CpuTexture exactly as it is laid out in memory. The key is the one of
+   the mesh cache, taken on the source image.
+ */
+struct TextureTilesHeader {
+  uint32_t magic;
+  uint32_t version;
+  MeshCacheKey key;
+  uint32_t levelCount;
+  uint32_t reserved;
+  uint64_t texelOffset;
+  uint64_t texelCount;
+};
+
+/* Tile files are kept in a cache directory, not next to the image: the
+   assets may be read only or shared, and a tile file is about 4/3 of the
+   decoded image. They are named after the path hash of the key; the rest
+   of the key tells a stale file apart.
+ */
+inline std::string getDefaultTextureTilesDirectory() {
+  std::error_code err;
+  std::filesystem::path temp = std::filesystem::temp_directory_path(err);
+  if (err) {
+    temp = ".";
+  }
+  return (temp / "texturetiles").string();
+}
+
+inline std::string getTextureTilesPath(const std::string &directory,
+                                       const MeshCacheKey &key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tiles",
+                static_cast<unsigned long long>(key.pathHash));
+  return (std::filesystem::path(directory) / name).string();
+}
+
+inline bool writeTextureTiles(const std::string &path, const MeshCacheKey &key,
+                              const CpuTexture &texture) {
+  // written to a temporary file and renamed, like the mesh cache
+  const std::vector<TextureLevel> &levels = texture.getLevels();
+  const std::vector<uint32_t> &texels = texture.getTexelArray();
+  TextureTilesHeader header{};
+  header.magic = TEXTURE_TILES_MAGIC;
+  header.version = TEXTURE_TILES_VERSION;
+  header.key = key;
+  header.levelCount = static_cast<uint32_t>(levels.size());
+  uint64_t tableEnd =
+      sizeof(TextureTilesHeader) + levels.size() * sizeof(TextureLevel);
+  header.texelOffset = (tableEnd + TEXTURE_TILES_ALIGNMENT - 1) /
+                       TEXTURE_TILES_ALIGNMENT * TEXTURE_TILES_ALIGNMENT;
+  header.texelCount = texels.size();
+
+  std::string tempPath = path + ".tmp";
+  std::error_code err;
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(levels.data()),
+              static_cast<std::streamsize>(levels.size() *
+                                           sizeof(TextureLevel)));
+    const char padding[TEXTURE_TILES_ALIGNMENT] = {};
+    out.write(padding,
+              static_cast<std::streamsize>(header.texelOffset - tableEnd));
+    out.write(reinterpret_cast<const char *>(texels.data()),
+              static_cast<std::streamsize>(texels.size() * sizeof(uint32_t)));
+    out.close();
+    if (!out) {
+      std::filesystem::remove(tempPath, err);
+      return false;
+    }
+  }
+  std::filesystem::rename(tempPath, path, err);
+  if (err) {
+    std::filesystem::remove(tempPath, err);
+    return false;
+  }
+  return true;
+}
+
+struct TileCacheStats {
+  unsigned long lookups = 0;
+  unsigned long pageIns = 0;
+  unsigned long evictions = 0;
+  // time lookups spent waiting for blocks to page in
+  double stallSeconds = 0.0;
+  std::size_t residentBytes = 0;
+  std::size_t peakResidentBytes = 0;
+
+  double getHitRate() const {
+    return this->lookups == 0
+               ? 1.0
+               : 1.0 - double(this->pageIns) / double(this->lookups);
+  }
+};
+
+/* Texture read block by block from a mapped tile file.
+   Opening one costs a header check, no texel is read until a lookup
+   touches its block. Lookups take the same path as CpuTexture; the only
+   difference is getTexels, which makes sure the blocks of the quad are
+   resident through the process wide TextureTileCache.
+ */
+class TiledTexture {
+public:
+  TiledTexture() {}
+  ~TiledTexture();
+  TiledTexture(const TiledTexture &) = delete;
+  TiledTexture &operator=(const TiledTexture &) = delete;
+
+  // maps a tile file, false if it is missing, stale for key or truncated
+  bool open(const std::string &tilesPath, const MeshCacheKey *key = nullptr);
+  /* Maps the tiles of an image from tilesDirectory. When there are none
+     or they are stale, the image is decoded whole and its mip chain built
+     in memory first, which costs as much as loading it as a CpuTexture
+     and peaks at the decoded image plus the pyramid. Later opens, in this
+     run or the next, only check the header.
+   */
+  bool openImage(const std::string &imagePath,
+                 const std::string &tilesDirectory);
+
+  int getWidth() const { return this->levels.empty() ? 0 : levels[0].width; }
+  int getHeight() const {
+    return this->levels.empty() ? 0 : levels[0].height;
+  }
+  int getLevelCount() const { return static_cast<int>(this->levels.size()); }
+  const TextureLevel &getLevel(int level) const { return levels[level]; }
+  // bytes of the texel array, resident or not
+  std::size_t getMemorySize() const {
+    return static_cast<std::size_t>(this->texelCount) * sizeof(uint32_t);
+  }
+  const uint32_t *getTexels(int level, int x0, int y0, int x1, int y1) const;
+
+  glm::vec4 sampleBilinear(glm::vec2 uv, int level = 0) const {
+    return sampleTextureBilinear(*this, uv, level);
+  }
+  glm::vec4 sampleTrilinear(glm::vec2 uv, float lod) const {
+    return sampleTextureTrilinear(*this, uv, lod);
+  }
+  glm::vec4 sampleDifferential(glm::vec2 uv, glm::vec2 duvdx,
+                               glm::vec2 duvdy) const {
+    return sampleTextureDifferential(*this, uv, duvdx, duvdy);
+  }
+
+private:
+  friend class TextureTileCache;
+
+  MappedFile file;
+  std::vector<TextureLevel> levels;
+  // global index of the first block of every level
+  std::vector<uint32_t> firstBlock;
+  const uint32_t *texels = nullptr;
+  uint64_t texelOffset = 0;
+  uint64_t texelCount = 0;
+  uint32_t blockCount = 0;
+  // resident set, read without a lock
+  std::unique_ptr<std::atomic<bool>[]> resident;
+  std::unique_ptr<std::atomic<bool>[]> referenced;
+
+  void acquire(uint32_t block) const;
+  void getBlockRange(uint32_t block, uint64_t &offset, uint64_t &size) const;
+};
+
+/* Process wide residency of tiled texture blocks.
+   Blocks of every open TiledTexture share one memory budget. A miss pages
+   the block in with madvise(WILLNEED) and a prefault under the mutex of
+   the cache; a hit is two relaxed atomic loads. When the budget would be
+   exceeded, a clock sweep over the resident blocks, an approximation of
+   lru, drops blocks that were not looked up since the last sweep with
+   madvise(DONTNEED). A lookup racing with the drop of its block is safe,
+   the mapping stays valid and the page is read again, so nothing is
+   pinned. Lookup counts are batched per thread to keep render threads
+   from sharing a counter.
+ */
+class TextureTileCache {
+public:
+  static TextureTileCache &getInstance();
+
+  void setMemoryBudget(std::size_t bytes);
+  // where tile files are written, getDefaultTextureTilesDirectory at first
+  void setTilesDirectory(const std::string &directory);
+  std::string getTilesDirectory();
+  /* Texture of an image path, shared by every caller while it is alive.
+     The first open of an image ever pays for a full decode and a tile
+     file write, see TiledTexture::openImage.
+   */
+  std::shared_ptr<TiledTexture> open(const std::string &imagePath);
+  TileCacheStats getStats();
+
+private:
+  friend class TiledTexture;
+
+  struct ResidentBlock {
+    TiledTexture *texture;
+    uint32_t block;
+  };
+  static constexpr unsigned long LOOKUP_BATCH = 256;
+
+  std::mutex mutex;
+  std::size_t memoryBudget = std::size_t(512) << 20;
+  std::string tilesDirectory = getDefaultTextureTilesDirectory();
+  std::vector<ResidentBlock> residentBlocks;
+  std::size_t clockHand = 0;
+  std::unordered_map<std::string, std::weak_ptr<TiledTexture>> byPath;
+  std::atomic<unsigned long> lookupCount{0};
+  std::atomic<uint64_t> stallNanoseconds{0};
+  TileCacheStats stats;
+
+  void countLookup();
+  void pageIn(const TiledTexture &texture, uint32_t block);
+  void evictFor(std::size_t bytes);
+  void forget(const TiledTexture &texture);
+};
+
+inline TextureTileCache &TextureTileCache::getInstance() {
+  static TextureTileCache cache;
+  return cache;
+}
+
+inline void TextureTileCache::setMemoryBudget(std::size_t bytes) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->memoryBudget = bytes;
+  this->evictFor(0);
+}
+
+inline void TextureTileCache::setTilesDirectory(const std::string &directory) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->tilesDirectory = directory;
+}
+
+inline std::string TextureTileCache::getTilesDirectory() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->tilesDirectory;
+}
+
+inline std::shared_ptr<TiledTexture>
+TextureTileCache::open(const std::string &imagePath) {
+  std::error_code err;
+  std::string key = std::filesystem::weakly_canonical(imagePath, err).string();
+  if (err) {
+    key = imagePath;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->byPath.find(key);
+    if (it != this->byPath.end()) {
+      if (std::shared_ptr<TiledTexture> alive = it->second.lock()) {
+        return alive;
+      }
+    }
+  }
+  // a cold open decodes the image, that happens outside the lock
+  std::shared_ptr<TiledTexture> texture = std::make_shared<TiledTexture>();
+  if (!texture->openImage(key, this->getTilesDirectory())) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::weak_ptr<TiledTexture> &slot = this->byPath[key];
+  if (std::shared_ptr<TiledTexture> other = slot.lock()) {
+    // opened by another thread meanwhile
+    return other;
+  }
+  slot = texture;
+  return texture;
+}
+
+inline void TextureTileCache::countLookup() {
+  static thread_local unsigned long pending = 0;
+  if (++pending == LOOKUP_BATCH) {
+    this->lookupCount.fetch_add(pending, std::memory_order_relaxed);
+    pending = 0;
+  }
+}
+
+inline void TextureTileCache::evictFor(std::size_t bytes) {
+  /* Clock sweep, called with the mutex held. A referenced block gets a
+     second chance, the first unreferenced one is dropped and the last
+     resident block takes its slot. Two turns clear every reference bit.
+   */
+  std::size_t steps = 2 * this->residentBlocks.size() + 1;
+  for (std::size_t step = 0;
+       step < steps && !this->residentBlocks.empty() &&
+       this->stats.residentBytes + bytes > this->memoryBudget;
+       step++) {
+    if (this->clockHand >= this->residentBlocks.size()) {
+      this->clockHand = 0;
+    }
+    ResidentBlock entry = this->residentBlocks[this->clockHand];
+    const TiledTexture &t = *entry.texture;
+    if (t.referenced[entry.block].exchange(false,
+                                           std::memory_order_relaxed)) {
+      this->clockHand++;
+      continue;
+    }
+    uint64_t offset, size;
+    t.getBlockRange(entry.block, offset, size);
+    t.resident[entry.block].store(false, std::memory_order_relaxed);
+    t.file.dontNeed(offset, size);
+    this->stats.residentBytes -= size;
+    this->stats.evictions++;
+    this->residentBlocks[this->clockHand] = this->residentBlocks.back();
+    this->residentBlocks.pop_back();
+  }
+}
+
+inline void TextureTileCache::pageIn(const TiledTexture &texture,
+                                     uint32_t block) {
+  auto start = std::chrono::steady_clock::now();
+  uint64_t offset, size;
+  texture.getBlockRange(block, offset, size);
+  bool loaded = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!texture.resident[block].load(std::memory_order_relaxed)) {
+      this->evictFor(size);
+      texture.resident[block].store(true, std::memory_order_relaxed);
+      this->residentBlocks.push_back(
+          ResidentBlock{const_cast<TiledTexture *>(&texture), block});
+      this->stats.residentBytes += size;
+      this->stats.peakResidentBytes =
+          std::max(this->stats.peakResidentBytes, this->stats.residentBytes);
+      this->stats.pageIns++;
+      loaded = true;
+    }
+  }
+  if (loaded) {
+    // fault the whole block in now instead of page by page in the filter
+    texture.file.willNeed(offset, size);
+    const volatile unsigned char *bytes = texture.file.data() + offset;
+    std::size_t page = MappedFile::getPageSize();
+    for (std::size_t i = 0; i < size; i += page) {
+      (void)bytes[i];
+    }
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  this->stallNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()),
+                                   std::memory_order_relaxed);
+}
+
+inline void TextureTileCache::forget(const TiledTexture &texture) {
+  // a closing texture takes its blocks out of the budget
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::size_t kept = 0;
+  for (const ResidentBlock &entry : this->residentBlocks) {
+    if (entry.texture == &texture) {
+      uint64_t offset, size;
+      texture.getBlockRange(entry.block, offset, size);
+      this->stats.residentBytes -= size;
+    } else {
+      this->residentBlocks[kept++] = entry;
+    }
+  }
+  this->residentBlocks.resize(kept);
+}
+
+inline TileCacheStats TextureTileCache::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  TileCacheStats s = this->stats;
+  s.lookups = std::max(this->lookupCount.load(), s.pageIns);
+  s.stallSeconds = this->stallNanoseconds.load() * 1.0e-9;
+  return s;
+}
+
+inline TiledTexture::~TiledTexture() {
+  if (this->blockCount > 0) {
+    TextureTileCache::getInstance().forget(*this);
+  }
+}
+
+inline bool TiledTexture::open(const std::string &tilesPath,
+                               const MeshCacheKey *key) {
+  if (this->blockCount > 0) {
+    TextureTileCache::getInstance().forget(*this);
+  }
+  this->levels.clear();
+  this->firstBlock.clear();
+  this->blockCount = 0;
+  this->texels = nullptr;
+  if (!this->file.open(tilesPath)) {
+    return false;
+  }
+  const TextureTilesHeader *header =
+      reinterpret_cast<const TextureTilesHeader *>(this->file.data());
+  bool valid = this->file.size() >= sizeof(TextureTilesHeader) &&
+               header->magic == TEXTURE_TILES_MAGIC &&
+               header->version == TEXTURE_TILES_VERSION &&
+               (!key || header->key == *key) && header->levelCount > 0 &&
+               header->levelCount <= 32 &&
+               header->texelOffset % TEXTURE_TILES_ALIGNMENT == 0 &&
+               header->texelOffset >=
+                   sizeof(TextureTilesHeader) +
+                       header->levelCount * sizeof(TextureLevel) &&
+               header->texelOffset <= this->file.size() &&
+               header->texelCount <=
+                   (this->file.size() - header->texelOffset) /
+                       sizeof(uint32_t);
+  if (valid) {
+    const TextureLevel *table = reinterpret_cast<const TextureLevel *>(
+        this->file.data() + sizeof(TextureTilesHeader));
+    this->levels.assign(table, table + header->levelCount);
+    for (const TextureLevel &level : this->levels) {
+      valid = valid && level.first + level.getTexelCount() <=
+                           header->texelCount;
+    }
+  }
+  if (!valid) {
+    this->levels.clear();
+    this->file.close();
+    return false;
+  }
+  this->texelOffset = header->texelOffset;
+  this->texelCount = header->texelCount;
+  this->texels =
+      reinterpret_cast<const uint32_t *>(this->file.data() + texelOffset);
+  for (const TextureLevel &level : this->levels) {
+    this->firstBlock.push_back(this->blockCount);
+    this->blockCount += level.getBlockCount();
+  }
+  this->resident.reset(new std::atomic<bool>[this->blockCount]);
+  this->referenced.reset(new std::atomic<bool>[this->blockCount]);
+  for (uint32_t b = 0; b < this->blockCount; b++) {
+    this->resident[b].store(false);
+    this->referenced[b].store(false);
+  }
+  return true;
+}
+
+inline bool TiledTexture::openImage(const std::string &imagePath,
+                                    const std::string &tilesDirectory) {
+  MeshCacheKey key;
+  if (!makeMeshCacheKey(imagePath, TEXTURE_TILES_VERSION, key)) {
+    return false;
+  }
+  std::string tilesPath = getTextureTilesPath(tilesDirectory, key);
+  if (this->open(tilesPath, &key)) {
+    return true;
+  }
+
+  // first use of the image: decode it once and keep the tiles
+  MappedFile image;
+  if (!image.open(imagePath)) {
+    return false;
+  }
+  int width, height, nrComponents;
+  unsigned char *pixels =
+      decodeImage(image.data(), image.size(), width, height, nrComponents);
+  if (!pixels) {
+    return false;
+  }
+  CpuTexture texture;
+  bool built = texture.build(pixels, width, height, nrComponents);
+  std::free(pixels);
+  if (!built) {
+    return false;
+  }
+  std::error_code err;
+  std::filesystem::create_directories(tilesDirectory, err);
+  if (!writeTextureTiles(tilesPath, key, texture)) {
+    std::cout << "WARNING::TEXTURETILES::could not write " << tilesPath
+              << std::endl;
+    return false;
+  }
+  return this->open(tilesPath, &key);
+}
+
+inline void TiledTexture::getBlockRange(uint32_t block, uint64_t &offset,
+                                        uint64_t &size) const {
+  std::size_t l = static_cast<std::size_t>(
+      std::upper_bound(this->firstBlock.begin(), this->firstBlock.end(),
+                       block) -
+      this->firstBlock.begin() - 1);
+  const TextureLevel &level = this->levels[l];
+  uint64_t local = block - this->firstBlock[l];
+  offset = this->texelOffset +
+           (level.first + local * level.blockStride) * sizeof(uint32_t);
+  size = level.blockStride * sizeof(uint32_t);
+}
+
+inline void TiledTexture::acquire(uint32_t block) const {
+  TextureTileCache &cache = TextureTileCache::getInstance();
+  cache.countLookup();
+  if (!this->resident[block].load(std::memory_order_relaxed)) {
+    cache.pageIn(*this, block);
+  }
+  // only written when it changes, hits stay read only
+  if (!this->referenced[block].load(std::memory_order_relaxed)) {
+    this->referenced[block].store(true, std::memory_order_relaxed);
+  }
+}
+
+inline const uint32_t *TiledTexture::getTexels(int l, int x0, int y0, int x1,
+                                               int y1) const {
+  // the quad spans one block unless it sits on a block edge
+  const TextureLevel &level = this->levels[l];
+  uint32_t base = this->firstBlock[l];
+  uint32_t b00 = level.getBlock(x0, y0);
+  uint32_t b11 = level.getBlock(x1, y1);
+  this->acquire(base + b00);
+  if (b11 != b00) {
+    this->acquire(base + b11);
+    uint32_t b10 = level.getBlock(x1, y0);
+    uint32_t b01 = level.getBlock(x0, y1);
+    if (b10 != b00 && b10 != b11) {
+      this->acquire(base + b10);
+    }
+    if (b01 != b00 && b01 != b11) {
+      this->acquire(base + b01);
+    }
+  }
+  return this->texels;
+}
+
+#endif
@@ -0,0 +1,55 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef TRIANGLE_HPP
+#define TRIANGLE_HPP
+
+#include <custom/ray.hpp>
+
+#include <cmath>
+
+template <typename T> struct TriangleT {
+  Vec3T<T> a;
+  Vec3T<T> b;
+  Vec3T<T> c;
+
+  // u and v are the barycentric weights of b and c at the hit
+  bool hit(const RayT<T> &ray, T tmin, T tmax, T &t, T &u, T &v) const;
+};
+
+template <typename T>
+bool TriangleT<T>::hit(const RayT<T> &ray, T tmin, T tmax, T &t, T &u,
+                       T &v) const {
+  // moller trumbore, no backface culling
+  Vec3T<T> e1 = this->b - this->a;
+  Vec3T<T> e2 = this->c - this->a;
+  Vec3T<T> p = glm::cross(ray.direction, e2);
+  T det = glm::dot(e1, p);
+  if (std::abs(det) < T(1.0e-12)) {
+    return false;
+  }
+  T invDet = T(1) / det;
+  Vec3T<T> s = ray.origin - this->a;
+  T bu = glm::dot(s, p) * invDet;
+  if (bu < T(0) || bu > T(1)) {
+    return false;
+  }
+  Vec3T<T> q = glm::cross(s, e1);
+  T bv = glm::dot(ray.direction, q) * invDet;
+  if (bv < T(0) || bu + bv > T(1)) {
+    return false;
+  }
+  T dist = glm::dot(e2, q) * invDet;
+  if (dist <= tmin || dist >= tmax) {
+    return false;
+  }
+  t = dist;
+  u = bu;
+  v = bv;
+  return true;
+}
+
+using Triangle = TriangleT<float>;
+
+#endif
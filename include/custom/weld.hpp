@@ -0,0 +1,320 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include <custom/geometry.hpp>
+#include <custom/parallel.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+struct WeldSettings {
+  // position tolerance relative to the diagonal of the mesh bounds
+  float positionTolerance = 1.0e-6f;
+  // largest difference of a normal, tangent or bitangent component
+  float normalTolerance = 1.0e-3f;
+  float uvTolerance = 1.0e-5f;
+  // sort triangles along a morton curve and vertices by first use
+  bool reorder = true;
+  unsigned int threadCount = 0;
+};
+
+struct WeldStats {
+  std::size_t verticesBefore = 0;
+  std::size_t verticesAfter = 0;
+  std::size_t trianglesBefore = 0;
+  // triangles collapsed by welding are dropped
+  std::size_t trianglesAfter = 0;
+  double seconds = 0.0;
+};
+
+// spread the low 10 bits of v so that two zero bits follow every bit
+inline uint32_t expandMortonBits(uint32_t v) {
+  v &= 0x3ffu;
+  v = (v | (v << 16)) & 0x030000ffu;
+  v = (v | (v << 8)) & 0x0300f00fu;
+  v = (v | (v << 4)) & 0x030c30c3u;
+  v = (v | (v << 2)) & 0x09249249u;
+  return v;
+}
+
+// 30 bit morton code of a point given in [0, 1]^3
+inline uint32_t mortonCode(glm::vec3 p) {
+  glm::uvec3 q(glm::clamp(p * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f)));
+  return (expandMortonBits(q.x) << 2) | (expandMortonBits(q.y) << 1) |
+         expandMortonBits(q.z);
+}
+
+/* Merges the duplicated vertices of every mesh and reorders for locality.
+   Meshes are welded independently and concurrently, vertices are never
+   shared across meshes since their materials and tangent ranges differ.
+   The flat arrays are rebuilt from the welded meshes afterwards.
+ */
+class VertexWelder {
+public:
+  WeldSettings settings;
+
+  VertexWelder(const WeldSettings &s = WeldSettings()) : settings(s) {}
+  WeldStats weld(SceneGeometry &g) const;
+
+private:
+  // streams of one mesh after welding, indices are local to the mesh
+  struct WeldedMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> tangents;
+    std::vector<glm::vec3> bitangents;
+    std::vector<unsigned int> indices;
+  };
+
+  void weldMesh(const SceneGeometry &g, const GeometryMesh &mesh,
+                WeldedMesh &out) const;
+};
+
+inline bool nearlyEqual(glm::vec3 a, glm::vec3 b, float tolerance) {
+  glm::vec3 d = glm::abs(a - b);
+  return d.x <= tolerance && d.y <= tolerance && d.z <= tolerance;
+}
+
+inline uint64_t hashCell(glm::i64vec3 c) {
+  return static_cast<uint64_t>(c.x) * 73856093ull ^
+         static_cast<uint64_t>(c.y) * 19349663ull ^
+         static_cast<uint64_t>(c.z) * 83492791ull;
+}
+
+inline void VertexWelder::weldMesh(const SceneGeometry &g,
+                                   const GeometryMesh &mesh,
+                                   WeldedMesh &out) const {
+  const WeldSettings &settings = this->settings;
+  const unsigned int n = mesh.vertexCount;
+  if (n == 0) {
+    return;
+  }
+  const glm::vec3 *positions = &g.positions[mesh.firstVertex];
+  const glm::vec3 *normals = &g.normals[mesh.firstVertex];
+  const glm::vec2 *uvs = &g.uvs[mesh.firstVertex];
+  const glm::vec3 *tangents =
+      mesh.hasTangents() ? &g.tangents[mesh.firstTangent] : nullptr;
+  const glm::vec3 *bitangents =
+      mesh.hasTangents() ? &g.bitangents[mesh.firstTangent] : nullptr;
+  glm::vec3 lo = positions[0];
+  glm::vec3 hi = positions[0];
+  for (unsigned int i = 1; i < n; i++) {
+    lo = glm::min(lo, positions[i]);
+    hi = glm::max(hi, positions[i]);
+  }
+  float eps = std::max(settings.positionTolerance * glm::length(hi - lo),
+                       std::numeric_limits<float>::min());
+
+  /* Hash grid with cells twice the tolerance: every point closer than the
+     tolerance to a vertex lies in one of the 8 cells around the corner
+     nearest to that vertex. A cell keeps a chain of the unique vertices
+     inserted in it.
+   */
+  float cellSize = 2.0f * eps;
+  std::unordered_map<uint64_t, unsigned int> heads;
+  heads.reserve(n);
+  std::vector<unsigned int> next;
+  std::vector<unsigned int> original;
+  std::vector<unsigned int> remap(n);
+  const unsigned int END = ~0u;
+  for (unsigned int v = 0; v < n; v++) {
+    glm::vec3 cell = (positions[v] - lo) / cellSize;
+    glm::i64vec3 base(glm::floor(cell));
+    glm::vec3 frac = cell - glm::floor(cell);
+    glm::i64vec3 side(frac.x < 0.5f ? -1 : 1, frac.y < 0.5f ? -1 : 1,
+                      frac.z < 0.5f ? -1 : 1);
+    unsigned int found = END;
+    for (int k = 0; k < 8 && found == END; k++) {
+      glm::i64vec3 c = base + glm::i64vec3(k & 1 ? side.x : 0,
+                                           k & 2 ? side.y : 0,
+                                           k & 4 ? side.z : 0);
+      auto it = heads.find(hashCell(c));
+      for (unsigned int u = it == heads.end() ? END : it->second;
+           u != END && found == END; u = next[u]) {
+        unsigned int w = original[u];
+        bool same =
+            glm::length(positions[v] - positions[w]) <= eps &&
+            nearlyEqual(normals[v], normals[w], settings.normalTolerance) &&
+            glm::abs(uvs[v] - uvs[w]).x <= settings.uvTolerance &&
+            glm::abs(uvs[v] - uvs[w]).y <= settings.uvTolerance &&
+            (!tangents ||
+             (nearlyEqual(tangents[v], tangents[w],
+                          settings.normalTolerance) &&
+              nearlyEqual(bitangents[v], bitangents[w],
+                          settings.normalTolerance)));
+        if (same) {
+          found = u;
+        }
+      }
+    }
+    if (found == END) {
+      found = static_cast<unsigned int>(original.size());
+      original.push_back(v);
+      auto inserted = heads.emplace(hashCell(base), found);
+      next.push_back(inserted.second ? END : inserted.first->second);
+      inserted.first->second = found;
+    }
+    remap[v] = found;
+  }
+
+  // indices of the unique vertices, triangles with a repeated corner have
+  // no area left and are dropped
+  const unsigned int *indices = &g.indices[mesh.firstIndex];
+  std::vector<unsigned int> welded;
+  welded.reserve(mesh.indexCount);
+  for (unsigned int t = 0; t + 2 < mesh.indexCount; t += 3) {
+    unsigned int a = remap[indices[t] - mesh.firstVertex];
+    unsigned int b = remap[indices[t + 1] - mesh.firstVertex];
+    unsigned int c = remap[indices[t + 2] - mesh.firstVertex];
+    if (a != b && b != c && a != c) {
+      welded.push_back(a);
+      welded.push_back(b);
+      welded.push_back(c);
+    }
+  }
+  std::size_t triangleCount = welded.size() / 3;
+
+  // neighbouring triangles end up next to each other in memory
+  std::vector<unsigned int> order(triangleCount);
+  for (std::size_t t = 0; t < triangleCount; t++) {
+    order[t] = static_cast<unsigned int>(t);
+  }
+  if (settings.reorder) {
+    glm::vec3 extent = hi - lo;
+    glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+    std::vector<uint32_t> codes(triangleCount);
+    for (std::size_t t = 0; t < triangleCount; t++) {
+      glm::vec3 centroid = (positions[original[welded[3 * t]]] +
+                            positions[original[welded[3 * t + 1]]] +
+                            positions[original[welded[3 * t + 2]]]) /
+                           3.0f;
+      codes[t] = mortonCode((centroid - lo) * invExtent);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned int a, unsigned int b) {
+                       return codes[a] < codes[b];
+                     });
+  }
+
+  // vertices are numbered by first use, unreferenced ones disappear
+  std::vector<unsigned int> number(original.size(), END);
+  out.indices.resize(3 * triangleCount);
+  unsigned int used = 0;
+  for (std::size_t t = 0; t < triangleCount; t++) {
+    for (unsigned int k = 0; k < 3; k++) {
+      unsigned int u = welded[3 * order[t] + k];
+      if (number[u] == END) {
+        number[u] = used++;
+      }
+      out.indices[3 * t + k] = number[u];
+    }
+  }
+  out.positions.resize(used);
+  out.normals.resize(used);
+  out.uvs.resize(used);
+  if (tangents) {
+    out.tangents.resize(used);
+    out.bitangents.resize(used);
+  }
+  for (std::size_t u = 0; u < original.size(); u++) {
+    if (number[u] == END) {
+      continue;
+    }
+    unsigned int w = original[u];
+    out.positions[number[u]] = positions[w];
+    out.normals[number[u]] = normals[w];
+    out.uvs[number[u]] = uvs[w];
+    if (tangents) {
+      out.tangents[number[u]] = tangents[w];
+      out.bitangents[number[u]] = bitangents[w];
+    }
+  }
+}
+
+inline WeldStats VertexWelder::weld(SceneGeometry &g) const {
+  const WeldSettings &settings = this->settings;
+  auto start = std::chrono::steady_clock::now();
+  WeldStats stats;
+  stats.verticesBefore = g.positions.size();
+  stats.trianglesBefore = g.getTriangleCount();
+
+  std::vector<WeldedMesh> welded(g.meshes.size());
+  parallelFor(
+      0, g.meshes.size(),
+      [&](std::size_t m) { this->weldMesh(g, g.meshes[m], welded[m]); },
+      settings.threadCount, 1);
+
+  unsigned int vertexCount = 0;
+  unsigned int indexCount = 0;
+  unsigned int tangentCount = 0;
+  for (std::size_t m = 0; m < g.meshes.size(); m++) {
+    GeometryMesh &range = g.meshes[m];
+    range.firstVertex = vertexCount;
+    range.vertexCount = static_cast<unsigned int>(welded[m].positions.size());
+    range.firstIndex = indexCount;
+    range.indexCount = static_cast<unsigned int>(welded[m].indices.size());
+    if (range.hasTangents()) {
+      range.firstTangent = tangentCount;
+      tangentCount += range.vertexCount;
+    }
+    vertexCount += range.vertexCount;
+    indexCount += range.indexCount;
+  }
+  g.positions.resize(vertexCount);
+  g.normals.resize(vertexCount);
+  g.uvs.resize(vertexCount);
+  g.tangents.resize(tangentCount);
+  g.bitangents.resize(tangentCount);
+  g.indices.resize(indexCount);
+  g.triangleMaterials.resize(indexCount / 3);
+
+  parallelFor(
+      0, g.meshes.size(),
+      [&](std::size_t m) {
+        const GeometryMesh &range = g.meshes[m];
+        const WeldedMesh &w = welded[m];
+        std::copy(w.positions.begin(), w.positions.end(),
+                  g.positions.begin() + range.firstVertex);
+        std::copy(w.normals.begin(), w.normals.end(),
+                  g.normals.begin() + range.firstVertex);
+        std::copy(w.uvs.begin(), w.uvs.end(),
+                  g.uvs.begin() + range.firstVertex);
+        if (range.hasTangents()) {
+          std::copy(w.tangents.begin(), w.tangents.end(),
+                    g.tangents.begin() + range.firstTangent);
+          std::copy(w.bitangents.begin(), w.bitangents.end(),
+                    g.bitangents.begin() + range.firstTangent);
+        }
+        for (unsigned int i = 0; i < range.indexCount; i++) {
+          g.indices[range.firstIndex + i] = range.firstVertex + w.indices[i];
+        }
+        std::fill(g.triangleMaterials.begin() + range.firstIndex / 3,
+                  g.triangleMaterials.begin() +
+                      (range.firstIndex + range.indexCount) / 3,
+                  range.materialId);
+      },
+      settings.threadCount, 1);
+
+  stats.verticesAfter = g.positions.size();
+  stats.trianglesAfter = g.getTriangleCount();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  stats.seconds = elapsed.count();
+  return stats;
+}
+
+#endif
@@ -0,0 +1,136 @@
+// bellege sigmayan geometri: kume akisi, sayfa yukleme ve bekleme suresi
+#include <custom/camera.hpp>
+#include <custom/clustergeometry.hpp>
+#include <custom/geometry.hpp>
+#include <custom/parallel.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+const int RESIM_EN = 512;
+const int RESIM_BOY = 512;
+const unsigned int KURE_SATIR = 8;
+const unsigned int KURE_BOYU = 96;
+// kume dosyasinin yaklasik dortte biri
+const std::size_t BELLEK_BUTCESI = std::size_t(16) << 20;
+
+// KURE_SATIR x KURE_SATIR kureden olusan tek bir ag
+SceneGeometry geometriKur() {
+  SceneGeometry g;
+  GeometryMesh ag;
+  ag.firstVertex = 0;
+  ag.firstIndex = 0;
+  ag.materialId = 0;
+  for (unsigned int m = 0; m < KURE_SATIR * KURE_SATIR; m++) {
+    glm::vec3 merkez((float(m % KURE_SATIR) - 3.5f) * 2.5f,
+                     (float(m / KURE_SATIR) - 3.5f) * 2.5f, -20.0f);
+    unsigned int ilk = static_cast<unsigned int>(g.positions.size());
+    for (unsigned int j = 0; j < KURE_BOYU; j++) {
+      for (unsigned int i = 0; i < KURE_BOYU; i++) {
+        float u = float(i) / float(KURE_BOYU - 1);
+        float v = float(j) / float(KURE_BOYU - 1);
+        float phi = u * glm::two_pi<float>();
+        float theta = v * glm::pi<float>();
+        glm::vec3 n(std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi));
+        g.positions.push_back(merkez + n);
+        g.normals.push_back(n);
+        g.uvs.push_back(glm::vec2(u, v));
+      }
+    }
+    for (unsigned int j = 0; j + 1 < KURE_BOYU; j++) {
+      for (unsigned int i = 0; i + 1 < KURE_BOYU; i++) {
+        unsigned int k = ilk + j * KURE_BOYU + i;
+        unsigned int dortgen[6] = {k,     k + KURE_BOYU, k + 1,
+                                   k + 1, k + KURE_BOYU, k + KURE_BOYU + 1};
+        g.indices.insert(g.indices.end(), dortgen, dortgen + 6);
+        g.triangleMaterials.push_back(0);
+        g.triangleMaterials.push_back(0);
+      }
+    }
+  }
+  ag.vertexCount = static_cast<unsigned int>(g.positions.size());
+  ag.indexCount = static_cast<unsigned int>(g.indices.size());
+  g.meshes.push_back(ag);
+  return g;
+}
+
+// birincil isinlar, satirlar paralel
+double ciz(ClusterGeometry &kumeler, unsigned long &isabet) {
+  const Camera kamera(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), YAW,
+                      PITCH, 90.0f);
+  const float en_boy = float(RESIM_EN) / float(RESIM_BOY);
+  std::vector<unsigned long> satirIsabet(RESIM_BOY, 0);
+  auto bas = std::chrono::steady_clock::now();
+  parallelFor(
+      0, RESIM_BOY,
+      [&](std::size_t j) {
+        for (int i = 0; i < RESIM_EN; i++) {
+          float u = (float(i) + 0.5f) / float(RESIM_EN);
+          float v = (float(j) + 0.5f) / float(RESIM_BOY);
+          GeometryHit kayit;
+          if (kumeler.intersect(kamera.getRay(u, v, en_boy), 1.0e-3f,
+                                INFINITY, kayit)) {
+            satirIsabet[j]++;
+          }
+        }
+      },
+      0, 1);
+  std::chrono::duration<double> sure = std::chrono::steady_clock::now() - bas;
+  isabet = 0;
+  for (unsigned long s : satirIsabet) {
+    isabet += s;
+  }
+  return sure.count();
+}
+
+int main(void) {
+  std::string yol =
+      (std::filesystem::temp_directory_path() / "akis.clusters").string();
+  {
+    SceneGeometry g = geometriKur();
+    if (!writeClusterFile(yol, g.getView())) {
+      std::cerr << "kume dosyasi yazilamadi: " << yol << std::endl;
+      return 1;
+    }
+  }
+
+  StreamingSettings ayar;
+  ayar.memoryBudget = BELLEK_BUTCESI;
+  ClusterGeometry kumeler(ayar);
+  if (!kumeler.open(yol)) {
+    std::cerr << "kume dosyasi acilamadi: " << yol << std::endl;
+    return 1;
+  }
+  double mb = 1024.0 * 1024.0;
+  std::cout << "ucgen: " << kumeler.getTriangleCount()
+            << " kume: " << kumeler.getClusterCount()
+            << " dosya: " << std::filesystem::file_size(yol) / mb
+            << " MB butce: " << BELLEK_BUTCESI / mb << " MB" << std::endl;
+
+  StreamingStats once = kumeler.getStats();
+  for (int gecis = 0; gecis < 2; gecis++) {
+    unsigned long isabet = 0;
+    double sure = ciz(kumeler, isabet);
+    StreamingStats s = kumeler.getStats();
+    unsigned long yukleme = s.pageIns - once.pageIns;
+    double bekleme = s.stallSeconds - once.stallSeconds;
+    std::cout << "gecis " << gecis << ": " << sure << "s, "
+              << RESIM_EN * RESIM_BOY / sure / 1.0e6 << " Misin/s, isabet "
+              << isabet << std::endl;
+    std::cout << "  kume istegi: " << s.acquires - once.acquires
+              << " sayfa yukleme: " << yukleme << " (" << yukleme / sure
+              << " /s) bosaltma: " << s.evictions - once.evictions
+              << std::endl;
+    std::cout << "  bekleme: " << bekleme << "s (" << 100.0 * bekleme / sure
+              << "% isin zamani) en cok yerlesik: "
+              << s.peakResidentBytes / mb << " MB" << std::endl;
+    once = s;
+  }
+  std::filesystem::remove(yol);
+  return 0;
+}
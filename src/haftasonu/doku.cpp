@@ -0,0 +1,179 @@
+// cpu dokusu: mip zinciri kurulumu, karo duzeni ve filtreleme maliyeti
+#include <custom/sampler.hpp>
+#include <custom/scene.hpp>
+#include <custom/texture.hpp>
+#include <custom/tiledtexture.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+const int DOKU_EN = 4096;
+const int DOKU_BOY = 4096;
+const unsigned int SORGU = 1 << 22;
+// karo dosyasinin sekizde biri
+const std::size_t BELLEK_BUTCESI = std::size_t(12) << 20;
+
+// karsilastirma icin satir satir saklanan ayni doku
+glm::vec4 satirBilinear(const std::vector<uint32_t> &satirlar, glm::vec2 uv) {
+  float x = uv.x * DOKU_EN - 0.5f;
+  float y = uv.y * DOKU_BOY - 0.5f;
+  float fx = std::floor(x), fy = std::floor(y);
+  int x0 = wrapTexel(static_cast<int>(fx), DOKU_EN);
+  int y0 = wrapTexel(static_cast<int>(fy), DOKU_BOY);
+  int x1 = (x0 + 1) % DOKU_EN;
+  int y1 = (y0 + 1) % DOKU_BOY;
+  return filterBilinear(satirlar[y0 * DOKU_EN + x0],
+                        satirlar[y0 * DOKU_EN + x1],
+                        satirlar[y1 * DOKU_EN + x0],
+                        satirlar[y1 * DOKU_EN + x1], x - fx, y - fy);
+}
+
+// dokuya egik bakan bir yuzeydeki komsu isinlarin uv degerleri
+glm::vec2 egikUv(unsigned int k) {
+  float s = float(k % 2048) / 2048.0f;
+  float t = float(k / 2048) / 2048.0f;
+  return glm::vec2(0.3f + 0.25f * t + 0.05f * s, 0.1f + 0.6f * s);
+}
+
+template <typename Fn> double olc(Fn fn, glm::vec4 &toplam) {
+  auto bas = std::chrono::steady_clock::now();
+  for (unsigned int k = 0; k < SORGU; k++) {
+    toplam += fn(k);
+  }
+  std::chrono::duration<double> sure = std::chrono::steady_clock::now() - bas;
+  return sure.count() * 1.0e9 / SORGU;
+}
+
+int main(void) {
+  // yumusak renk gecisleri ustunde ince bir izgara
+  std::vector<unsigned char> piksel(std::size_t(DOKU_EN) * DOKU_BOY * 3);
+  for (int y = 0; y < DOKU_BOY; y++) {
+    for (int x = 0; x < DOKU_EN; x++) {
+      unsigned char *p = &piksel[(std::size_t(y) * DOKU_EN + x) * 3];
+      bool cizgi = x % 64 == 0 || y % 64 == 0;
+      p[0] = static_cast<unsigned char>(cizgi ? 255 : x * 255 / DOKU_EN);
+      p[1] = static_cast<unsigned char>(cizgi ? 255 : y * 255 / DOKU_BOY);
+      p[2] = static_cast<unsigned char>((x ^ y) & 255);
+    }
+  }
+  std::vector<uint32_t> satirlar(std::size_t(DOKU_EN) * DOKU_BOY);
+  for (std::size_t i = 0; i < satirlar.size(); i++) {
+    satirlar[i] = packTexel(&piksel[i * 3], 3);
+  }
+
+  CpuTexture doku;
+  auto bas = std::chrono::steady_clock::now();
+  doku.build(piksel.data(), DOKU_EN, DOKU_BOY, 3);
+  std::chrono::duration<double> kurulum =
+      std::chrono::steady_clock::now() - bas;
+  std::cout << "kurulum: " << kurulum.count() << "s, " << doku.getLevelCount()
+            << " seviye, " << doku.getMemorySize() / (1024.0 * 1024.0)
+            << " MB" << std::endl;
+
+  // seviye 0 da karo duzeni ayni sonucu vermeli
+  Rng rng(7u);
+  float enBuyukFark = 0.0f;
+  for (unsigned int k = 0; k < 100000; k++) {
+    glm::vec2 uv(rng.next() * 3.0f - 1.0f, rng.next() * 3.0f - 1.0f);
+    glm::vec4 fark = doku.sampleBilinear(uv) - satirBilinear(satirlar, uv);
+    enBuyukFark = std::max(enBuyukFark, glm::length(fark));
+  }
+  std::cout << "satir duzenine gore en buyuk fark: " << enBuyukFark
+            << std::endl;
+
+  glm::vec4 toplam(0.0f);
+  std::vector<glm::vec2> rastgele(SORGU);
+  for (glm::vec2 &uv : rastgele) {
+    uv = glm::vec2(rng.next(), rng.next());
+  }
+  double satirEgik =
+      olc([&](unsigned int k) { return satirBilinear(satirlar, egikUv(k)); },
+          toplam);
+  double karoEgik =
+      olc([&](unsigned int k) { return doku.sampleBilinear(egikUv(k)); },
+          toplam);
+  double satirRastgele = olc(
+      [&](unsigned int k) { return satirBilinear(satirlar, rastgele[k]); },
+      toplam);
+  double karoRastgele =
+      olc([&](unsigned int k) { return doku.sampleBilinear(rastgele[k]); },
+          toplam);
+  double ucDogrusal = olc(
+      [&](unsigned int k) { return doku.sampleTrilinear(rastgele[k], 4.5f); },
+      toplam);
+  std::cout << "egik yuzey, satir: " << satirEgik << " ns karo: " << karoEgik
+            << " ns" << std::endl;
+  std::cout << "rastgele, satir: " << satirRastgele
+            << " ns karo: " << karoRastgele << " ns" << std::endl;
+  std::cout << "uc dogrusal (seviye 4.5): " << ucDogrusal << " ns"
+            << std::endl;
+  // ayni doku diskten karo karo, bellek butcesi altinda
+  std::string yol =
+      (std::filesystem::temp_directory_path() / "doku.tiles").string();
+  MeshCacheKey anahtar{};
+  if (!writeTextureTiles(yol, anahtar, doku)) {
+    std::cerr << "karo dosyasi yazilamadi: " << yol << std::endl;
+    return 1;
+  }
+  TextureTileCache::getInstance().setMemoryBudget(BELLEK_BUTCESI);
+  {
+    TiledTexture tembel;
+    tembel.open(yol, &anahtar);
+    double tembelEgik =
+        olc([&](unsigned int k) { return tembel.sampleBilinear(egikUv(k)); },
+            toplam);
+    double tembelUc = olc(
+        [&](unsigned int k) {
+          return tembel.sampleTrilinear(rastgele[k], 4.5f);
+        },
+        toplam);
+    TileCacheStats s = TextureTileCache::getInstance().getStats();
+    std::cout << "karo dosyasi, egik: " << tembelEgik
+              << " ns uc dogrusal: " << tembelUc << " ns" << std::endl;
+    std::cout << "  isabet: " << 100.0 * s.getHitRate()
+              << "% yukleme: " << s.pageIns << " bosaltma: " << s.evictions
+              << " yerlesik: " << s.residentBytes / (1024.0 * 1024.0)
+              << " MB / " << tembel.getMemorySize() / (1024.0 * 1024.0)
+              << " MB" << std::endl;
+  }
+  std::filesystem::remove(yol);
+
+  // sahne dokulari karo onbellegiyle acilir: ilk acilis resmi butunuyle
+  // cozer ve karo dosyasini yazar, sonrakiler yalnizca basligi okur
+  std::filesystem::path klasor =
+      std::filesystem::temp_directory_path() / "doku_karolar";
+  std::string resimYolu =
+      (std::filesystem::temp_directory_path() / "doku.ppm").string();
+  {
+    std::ofstream resim(resimYolu, std::ios::binary);
+    resim << "P6\n" << DOKU_EN << " " << DOKU_BOY << "\n255\n";
+    resim.write(reinterpret_cast<const char *>(piksel.data()),
+                static_cast<std::streamsize>(piksel.size()));
+  }
+  TextureTileCache::getInstance().setTilesDirectory(klasor.string());
+  for (const char *acilis : {"soguk", "sicak"}) {
+    Scene sahne;
+    bas = std::chrono::steady_clock::now();
+    int id = sahne.loadTexture(resimYolu);
+    std::chrono::duration<double> sure =
+        std::chrono::steady_clock::now() - bas;
+    if (id < 0) {
+      std::cerr << "resim acilamadi: " << resimYolu << std::endl;
+      return 1;
+    }
+    toplam += sahne.textures[id].sampleDifferential(
+        glm::vec2(0.5f), glm::vec2(0.001f, 0.0f), glm::vec2(0.0f, 0.001f));
+    std::cout << acilis << " acilis: " << sure.count() * 1000.0 << " ms"
+              << std::endl;
+  }
+  std::filesystem::remove(resimYolu);
+  std::filesystem::remove_all(klasor);
+
+  // derleyici donguleri atmasin
+  std::cerr << toplam.x + toplam.y + toplam.z + toplam.w << std::endl;
+  return 0;
+}
@@ -0,0 +1,105 @@
+// float ve double hassasiyet karsilastirmasi
+#include <custom/camera.hpp>
+#include <custom/framebuffer.hpp>
+#include <custom/integrator.hpp>
+#include <custom/sampler.hpp>
+#include <custom/scene.hpp>
+
+#include <cmath>
+#include <iostream>
+
+const int RESIM_EN = 256;
+const int RESIM_BOY = 256;
+const unsigned int ORNEK = 16;
+
+Scene sahneKur() {
+  Scene sahne;
+  int kirmizi = sahne.addMaterial(glm::vec3(0.7f, 0.3f, 0.3f));
+  int zemin = sahne.addMaterial(glm::vec3(0.8f, 0.8f, 0.0f));
+  sahne.addSphere(glm::vec3(0.0f, 0.0f, -1.0f), 0.5f, kirmizi);
+  sahne.addSphere(glm::vec3(0.0f, -100.5f, -1.0f), 100.0f, zemin);
+  sahne.directionalLights.push_back(DirectionalLight(
+      glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(2.0f), glm::vec3(1.0f)));
+  return sahne;
+}
+
+// kalabalik sahne: kesisim testleri kureleri vektor genisliginde isler,
+// float ile ayni komutta double'in iki kati kure
+Scene kalabalikSahneKur() {
+  Scene sahne = sahneKur();
+  int mavi = sahne.addMaterial(glm::vec3(0.2f, 0.3f, 0.8f));
+  for (int z = 0; z < 8; z++) {
+    for (int x = 0; x < 8; x++) {
+      sahne.addSphere(glm::vec3(-1.4f + 0.4f * x, -0.4f, -1.2f - 0.4f * z),
+                      0.1f, mavi);
+    }
+  }
+  return sahne;
+}
+
+// verilen hassasiyette sabit ornek sayisi ile cizer
+template <typename T>
+FramebufferT<T> ciz(const Scene &sahne, AdaptiveStats &istatistik) {
+  const CameraT<T> kamera(Vec3T<T>(T(0)), Vec3T<T>(T(0), T(1), T(0)), YAW,
+                          PITCH, T(90));
+  const T en_boy = T(RESIM_EN) / T(RESIM_BOY);
+
+  // esik sifir: her piksel tam ORNEK kadar ornek alir
+  AdaptiveSettings ayar;
+  ayar.minSamples = ORNEK;
+  ayar.maxSamples = ORNEK;
+  ayar.samplesPerPass = ORNEK;
+  ayar.errorThreshold = 0.0f;
+  ayar.targetNoise = 0.0f;
+
+  FramebufferT<T> cerceve(RESIM_EN, RESIM_BOY);
+  dispatchIntegrator<AOV_NONE, T>(sahne, [&](const auto &integrator) {
+    istatistik = renderAdaptive(
+        cerceve,
+        [&](int i, int j, Rng &rng) {
+          T u = (T(i) + T(rng.next())) / T(RESIM_EN);
+          T v = (T(j) + T(rng.next())) / T(RESIM_BOY);
+          return integrator.sample(kamera.getRay(u, v, en_boy), rng);
+        },
+        ayar);
+  });
+  return cerceve;
+}
+
+void karsilastir(const char *ad, const Scene &sahne) {
+  AdaptiveStats tek, cift;
+  FramebufferT<float> tekCerceve = ciz<float>(sahne, tek);
+  FramebufferT<double> ciftCerceve = ciz<double>(sahne, cift);
+
+  // double dogrulama icin referans
+  double hataKare = 0.0;
+  double enBuyukHata = 0.0;
+  for (int j = 0; j < RESIM_BOY; j++) {
+    for (int i = 0; i < RESIM_EN; i++) {
+      glm::dvec3 fark =
+          glm::dvec3(tekCerceve.getColor(i, j)) - ciftCerceve.getColor(i, j);
+      hataKare += glm::dot(fark, fark) / 3.0;
+      enBuyukHata = std::max(enBuyukHata, glm::length(fark));
+    }
+  }
+  double rmse = std::sqrt(hataKare / (RESIM_EN * RESIM_BOY));
+
+  auto yaz = [](const char *tur, const AdaptiveStats &s) {
+    std::cout << "  " << tur << ": " << s.seconds << "s, "
+              << s.sampleCount / s.seconds / 1.0e6 << " Mornek/s"
+              << std::endl;
+  };
+  std::cout << ad << " (" << sahne.spheres.size() << " kure)" << std::endl;
+  yaz("float ", tek);
+  yaz("double", cift);
+  std::cout << "  hizlanma: " << cift.seconds / tek.seconds << "x"
+            << std::endl;
+  std::cout << "  rmse: " << rmse << " en buyuk fark: " << enBuyukHata
+            << std::endl;
+}
+
+int main(void) {
+  karsilastir("iki kure", sahneKur());
+  karsilastir("kalabalik", kalabalikSahneKur());
+  return 0;
+}
@@ -0,0 +1,259 @@
+// cok sayida nokta isik: isik hiyerarsisi ya da guc tablosu ile tek isik
+// secimi
+#include <custom/integrator.hpp>
+#include <custom/lightbvh.hpp>
+#include <custom/sampler.hpp>
+#include <custom/scene.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// sokak lambalarindan olusan bir gece sehri
+const int IZGARA = 150;
+const float ARALIK = 0.5f;
+// her golgelendirme noktasinda bu kadar tahmin
+const int TAHMIN = 64;
+const int NOKTA = 2000;
+
+Scene sehirKur() {
+  Scene sahne;
+  Rng rng(7u);
+  for (int z = 0; z < IZGARA; z++) {
+    for (int x = 0; x < IZGARA; x++) {
+      glm::vec3 konum((x - IZGARA / 2) * ARALIK, 0.4f + 0.2f * rng.next(),
+                      -(z + 1) * ARALIK);
+      // cogu lamba sonuk, bazilari vitrin gibi parlak
+      float guc = rng.next() < 0.05f ? 8.0f : 0.5f + rng.next();
+      sahne.pointLights.push_back(
+          PointLight(konum, glm::vec3(guc), glm::vec3(1.0f, 0.8f, 0.5f),
+                     1.0f, 0.5f, 2.0f));
+    }
+  }
+  sahne.addSphere(glm::vec3(0.0f, -1000.0f, -30.0f), 1000.0f);
+  return sahne;
+}
+
+// golgesiz isinim, butun isiklar dolasilarak
+float tamIsinim(const PointLightArray &isiklar, glm::vec3 p, glm::vec3 n,
+                std::vector<float> &olcek, std::vector<float> &uzaklik) {
+  isiklar.getIrradianceScales(p, n, olcek.data(), uzaklik.data());
+  float toplam = 0.0f;
+  for (std::size_t i = 0; i < isiklar.size(); i++) {
+    toplam += getLightPower(isiklar.getColor(i)) * olcek[i];
+  }
+  return toplam;
+}
+
+// tek isikli tahmin, secim olasiligina bolunmus
+float tekIsik(const PointLightArray &isiklar, std::size_t i, float pmf,
+              glm::vec3 p, glm::vec3 n) {
+  glm::vec3 d = isiklar.getPosition(i) - p;
+  float uzaklik = glm::length(d);
+  float c = glm::dot(n, d) / uzaklik;
+  if (c <= 0.0f) {
+    return 0.0f;
+  }
+  return getLightPower(isiklar.getColor(i)) * c *
+         isiklar.getAttenuation(i, uzaklik) / pmf;
+}
+
+int main(void) {
+  Scene sahne = sehirKur();
+  const PointLightArray &isiklar = sahne.pointLights;
+
+  auto bas = std::chrono::steady_clock::now();
+  sahne.buildLightBvh();
+  double kurulum = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - bas)
+                       .count();
+  std::cout << isiklar.size() << " isik, hiyerarsi kurulumu: "
+            << kurulum * 1000.0 << " ms, derinlik "
+            << sahne.lightBvh.getDepth() << std::endl;
+
+  // zemin uzerinde rastgele noktalar
+  Rng rng(99u);
+  std::vector<glm::vec3> noktalar(NOKTA);
+  for (glm::vec3 &p : noktalar) {
+    p = glm::vec3((rng.next() - 0.5f) * IZGARA * ARALIK, 0.0f,
+                  -rng.next() * IZGARA * ARALIK);
+  }
+  const glm::vec3 n(0.0f, 1.0f, 0.0f);
+
+  // olasiliklar toplami bir olmali, ornek ile ayni olmali
+  double enBuyukFark = 0.0;
+  for (int k = 0; k < 4; k++) {
+    double toplam = 0.0;
+    for (std::size_t i = 0; i < isiklar.size(); i++) {
+      toplam += sahne.lightBvh.getPmf(noktalar[k], n, uint32_t(i));
+    }
+    enBuyukFark = std::max(enBuyukFark, std::abs(toplam - 1.0));
+  }
+  std::cout << "olasilik toplaminin birden en buyuk farki: " << enBuyukFark
+            << std::endl;
+
+  std::vector<float> olcek(isiklar.size()), uzaklik(isiklar.size());
+  std::vector<float> referans(NOKTA);
+  bas = std::chrono::steady_clock::now();
+  for (int k = 0; k < NOKTA; k++) {
+    referans[k] = tamIsinim(isiklar, noktalar[k], n, olcek, uzaklik);
+  }
+  double tamSure = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - bas)
+                       .count();
+
+  // tek ornekli tahminlerin goreli hatasi ve ortalamasi
+  double hiyerarsiKare = 0.0, duzgunKare = 0.0, ortalamaFark = 0.0;
+  bas = std::chrono::steady_clock::now();
+  for (int k = 0; k < NOKTA; k++) {
+    double ortalama = 0.0;
+    for (int t = 0; t < TAHMIN; t++) {
+      uint32_t i;
+      float pmf;
+      float e = 0.0f;
+      if (sahne.lightBvh.sample(noktalar[k], n, rng.next(), i, pmf)) {
+        e = tekIsik(isiklar, i, pmf, noktalar[k], n);
+      }
+      double fark = (e - referans[k]) / referans[k];
+      hiyerarsiKare += fark * fark;
+      ortalama += e;
+    }
+    ortalamaFark += (ortalama / TAHMIN - referans[k]) / referans[k];
+  }
+  double hiyerarsiSure = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - bas)
+                             .count();
+  for (int k = 0; k < NOKTA; k++) {
+    for (int t = 0; t < TAHMIN; t++) {
+      std::size_t i = std::min(std::size_t(rng.next() * isiklar.size()),
+                               isiklar.size() - 1);
+      float e = tekIsik(isiklar, i, 1.0f / isiklar.size(), noktalar[k], n);
+      double fark = (e - referans[k]) / referans[k];
+      duzgunKare += fark * fark;
+    }
+  }
+  std::cout << "butun isiklar: " << tamSure * 1.0e6 / NOKTA
+            << " us/nokta" << std::endl;
+  std::cout << "hiyerarsi: " << hiyerarsiSure * 1.0e6 / (NOKTA * TAHMIN)
+            << " us/ornek, goreli hata "
+            << std::sqrt(hiyerarsiKare / (NOKTA * TAHMIN))
+            << ", ortalama sapma " << ortalamaFark / NOKTA << std::endl;
+  std::cout << "duzgun secim goreli hata "
+            << std::sqrt(duzgunKare / (NOKTA * TAHMIN)) << std::endl;
+
+  // yalniz guce gore secim, sabit zamanli tablo
+  bas = std::chrono::steady_clock::now();
+  sahne.buildLightPowers();
+  kurulum = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          bas)
+                .count();
+  double gucKare = 0.0;
+  ortalamaFark = 0.0;
+  bas = std::chrono::steady_clock::now();
+  for (int k = 0; k < NOKTA; k++) {
+    double ortalama = 0.0;
+    for (int t = 0; t < TAHMIN; t++) {
+      float pmf;
+      uint32_t i = sahne.lightPowers.sample(rng.next(), &pmf);
+      float e = tekIsik(isiklar, i, pmf, noktalar[k], n);
+      double fark = (e - referans[k]) / referans[k];
+      gucKare += fark * fark;
+      ortalama += e;
+    }
+    ortalamaFark += (ortalama / TAHMIN - referans[k]) / referans[k];
+  }
+  double gucSure = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - bas)
+                       .count();
+  std::cout << "guc tablosu: kurulum " << kurulum * 1000.0 << " ms, "
+            << gucSure * 1.0e6 / (NOKTA * TAHMIN) << " us/ornek, goreli hata "
+            << std::sqrt(gucKare / (NOKTA * TAHMIN)) << ", ortalama sapma "
+            << ortalamaFark / NOKTA << std::endl;
+
+  // lambalar tek tek yanip sonuyor: yalniz degisen bloklar yeniden kurulur
+  const int DEGISIM = 1000;
+  bas = std::chrono::steady_clock::now();
+  for (int k = 0; k < DEGISIM; k++) {
+    std::size_t i = std::size_t(rng.next() * isiklar.size());
+    sahne.pointLights.setIntensity(i, glm::vec3(rng.next() * 10.0f));
+    sahne.updateLights();
+  }
+  double guncelleme = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - bas)
+                          .count();
+  // guncellenmis olasiliklar yeni guclerle orantili olmali
+  double gucToplam = 0.0, olasilikFarki = 0.0;
+  for (std::size_t i = 0; i < isiklar.size(); i++) {
+    gucToplam += getLightPower(isiklar.getColor(i));
+  }
+  for (std::size_t i = 0; i < isiklar.size(); i++) {
+    double beklenen = getLightPower(isiklar.getColor(i)) / gucToplam;
+    olasilikFarki = std::max(
+        olasilikFarki,
+        std::abs(sahne.lightPowers.getPdf(i) - beklenen) / beklenen);
+  }
+  bas = std::chrono::steady_clock::now();
+  sahne.buildLightPowers();
+  double yeniden = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - bas)
+                       .count();
+  std::cout << "tek isik guncelleme: " << guncelleme * 1.0e6 / DEGISIM
+            << " us, tum tablo: " << yeniden * 1.0e6
+            << " us, olasiligin en buyuk goreli farki " << olasilikFarki
+            << std::endl;
+
+  // kurulumdan sonra eklenen isik: guncellenene dek butun isiklar dolasilir,
+  // guncellemeyle tablo yeniden kurulur
+  sahne.pointLights.push_back(PointLight(glm::vec3(0.0f, 0.5f, -1.0f),
+                                         glm::vec3(1.0f), glm::vec3(1.0f)));
+  bool eski = sahne.getLightSelection() == LIGHTS_ALL;
+  sahne.updateLights();
+  std::cout << "eklenen isik: guncellemeden once butun isiklar "
+            << (eski ? "evet" : "hayir") << ", sonra tablo "
+            << sahne.lightPowers.getCount() << " isik" << std::endl;
+  sahne.buildLightBvh();
+
+  // tasinan isik: guncellenene dek butun isiklar dolasilir, guncelleme
+  // hiyerarsinin sinirlarini yeni yerine gore duzeltir
+  glm::vec3 yeniYer(37.0f, 0.5f, -74.0f);
+  glm::vec3 altinda(37.0f, 0.0f, -74.0f);
+  sahne.pointLights.setPosition(0, yeniYer);
+  float eskiPmf = sahne.lightBvh.getPmf(altinda, n, 0);
+  eski = sahne.getLightSelection() == LIGHTS_ALL;
+  sahne.updateLights();
+  float duzeltilmisPmf = sahne.lightBvh.getPmf(altinda, n, 0);
+  double pmfToplam = 0.0;
+  for (std::size_t i = 0; i < isiklar.size(); i++) {
+    pmfToplam += sahne.lightBvh.getPmf(altinda, n, uint32_t(i));
+  }
+  sahne.buildLightBvh();
+  std::cout << "tasinan isik: guncellemeden once butun isiklar "
+            << (eski ? "evet" : "hayir") << ", altindaki noktada olasilik "
+            << eskiPmf << " -> " << duzeltilmisPmf << " (yeniden kurulum "
+            << sahne.lightBvh.getPmf(altinda, n, 0) << "), olasilik toplami "
+            << pmfToplam << std::endl;
+
+  // integrator ile ornek basina sure, iki secim icin
+  RayT<float> isin{glm::vec3(0.0f, 3.0f, 2.0f),
+                   glm::normalize(glm::vec3(0.0f, -0.5f, -1.0f))};
+  for (LightSelection secim : {LIGHTS_BVH, LIGHTS_POWER}) {
+    sahne.lightSelection = secim;
+    dispatchIntegrator<AOV_NONE>(sahne, [&](const auto &integrator) {
+      const int ORNEK = 20000;
+      float toplam = 0.0f;
+      auto b = std::chrono::steady_clock::now();
+      for (int k = 0; k < ORNEK; k++) {
+        Rng r = makePixelRng(k, 1, 0);
+        toplam += integrator.sample(isin, r).x;
+      }
+      double s = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - b)
+                     .count();
+      std::cout << (secim == LIGHTS_BVH ? "hiyerarsi" : "guc tablosu")
+                << " ile integrator: " << s * 1.0e6 / ORNEK << " us/ornek ("
+                << toplam / ORNEK << ")" << std::endl;
+    });
+  }
+  return 0;
+}
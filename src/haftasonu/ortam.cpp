@@ -0,0 +1,165 @@
+// ortam haritasi: dagilim kurulumu ve onem ornekleme ile gurultu farki
+#include <custom/envlight.hpp>
+#include <custom/sampler.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+const int HARITA_EN = 4096;
+const int HARITA_BOY = 2048;
+// her tahmin bu kadar ornekle yapiliyor
+const int ORNEK = 16;
+const int DENEME = 4000;
+
+// kucuk ve cok parlak bir gunes ile sonuk bir gokyuzu
+std::vector<float> haritaYap() {
+  std::vector<float> rgb(std::size_t(HARITA_EN) * HARITA_BOY * 3);
+  glm::vec3 gunes = glm::normalize(glm::vec3(0.4f, 0.8f, 0.2f));
+  for (int y = 0; y < HARITA_BOY; y++) {
+    float theta = glm::pi<float>() * (y + 0.5f) / HARITA_BOY;
+    for (int x = 0; x < HARITA_EN; x++) {
+      float phi = glm::two_pi<float>() * (x + 0.5f) / HARITA_EN;
+      glm::vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta),
+                  std::sin(theta) * std::sin(phi));
+      glm::vec3 c = d.y > 0.0f ? glm::vec3(0.3f, 0.5f, 0.9f)
+                               : glm::vec3(0.2f, 0.18f, 0.15f);
+      if (glm::dot(d, gunes) > 0.9997f) {
+        c = glm::vec3(20000.0f, 18000.0f, 15000.0f);
+      }
+      float *p = &rgb[(std::size_t(y) * HARITA_EN + x) * 3];
+      p[0] = c.x;
+      p[1] = c.y;
+      p[2] = c.z;
+    }
+  }
+  return rgb;
+}
+
+// yukari bakan bir noktaya gelen isinim, kosinus agirlikli yonlerle
+float kosinusTahmini(const EnvironmentLight &ortam, Rng &rng) {
+  float toplam = 0.0f;
+  for (int i = 0; i < ORNEK; i++) {
+    float r = std::sqrt(rng.next());
+    float phi = glm::two_pi<float>() * rng.next();
+    glm::vec3 d(r * std::cos(phi), std::sqrt(1.0f - r * r), r * std::sin(phi));
+    // pdf cos / pi, kosinusu goturuyor
+    toplam += ortam.eval(d).y * glm::pi<float>();
+  }
+  return toplam / ORNEK;
+}
+
+// ayni isinim, haritanin parlakligina gore secilen yonlerle
+float haritaTahmini(const EnvironmentLight &ortam, Rng &rng) {
+  float toplam = 0.0f;
+  for (int i = 0; i < ORNEK; i++) {
+    glm::vec3 d;
+    float pdf;
+    glm::vec3 l = ortam.sample(glm::vec2(rng.next(), rng.next()), d, pdf);
+    if (pdf > 0.0f && d.y > 0.0f) {
+      toplam += l.y * d.y / pdf;
+    }
+  }
+  return toplam / ORNEK;
+}
+
+template <typename Fn>
+void hataYaz(const char *ad, const EnvironmentLight &ortam, float referans,
+             Fn tahmin) {
+  double kare = 0.0;
+  for (int k = 0; k < DENEME; k++) {
+    Rng rng = makePixelRng(k, 7, 1);
+    double fark = tahmin(ortam, rng) - referans;
+    kare += fark * fark;
+  }
+  std::cout << ad << " goreli hata: " << std::sqrt(kare / DENEME) / referans
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  EnvironmentLight ortam;
+  auto bas = std::chrono::steady_clock::now();
+  if (argc > 1) {
+    // istenirse bir hdr dosyasi
+    if (!ortam.load(argv[1])) {
+      std::cerr << argv[1] << " okunamadi" << std::endl;
+      return 1;
+    }
+  } else {
+    std::vector<float> rgb = haritaYap();
+    bas = std::chrono::steady_clock::now();
+    ortam.build(rgb.data(), HARITA_EN, HARITA_BOY);
+  }
+  double kurulum = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - bas)
+                       .count();
+  std::cout << ortam.getWidth() << "x" << ortam.getHeight()
+            << " dagilim kurulumu: " << kurulum * 1000.0 << " ms"
+            << std::endl;
+
+  // pdf kureyi kaplamali: piksel merkezlerinde pdf ile kati aci toplami
+  double kapsama = 0.0;
+  for (int y = 0; y < ortam.getHeight(); y++) {
+    float theta = glm::pi<float>() * (y + 0.5f) / ortam.getHeight();
+    double aci = 2.0 * glm::pi<double>() * glm::pi<double>() *
+                 std::sin(theta) /
+                 (double(ortam.getWidth()) * ortam.getHeight());
+    for (int x = 0; x < ortam.getWidth(); x++) {
+      float phi = glm::two_pi<float>() * (x + 0.5f) / ortam.getWidth();
+      glm::vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta),
+                  std::sin(theta) * std::sin(phi));
+      kapsama += ortam.getPdf(d) * aci;
+    }
+  }
+  // ornekleme ile ayni pdf, piksel sinirindaki yuvarlama disinda
+  Rng rng(12345u);
+  const int KONTROL = 1 << 20;
+  int farkli = 0;
+  for (int i = 0; i < KONTROL; i++) {
+    glm::vec3 o;
+    float pdf;
+    ortam.sample(glm::vec2(rng.next(), rng.next()), o, pdf);
+    if (pdf > 0.0f && std::abs(ortam.getPdf(o) - pdf) > 1.0e-3f * pdf) {
+      farkli++;
+    }
+  }
+  std::cout << "pdf integrali: " << kapsama
+            << " pdf farkli ornek orani: " << double(farkli) / KONTROL
+            << std::endl;
+
+  // referans cok sayida harita ornegiyle
+  double referans = 0.0;
+  const int REF = 1 << 22;
+  for (int i = 0; i < REF; i++) {
+    glm::vec3 d;
+    float pdf;
+    glm::vec3 l = ortam.sample(glm::vec2(rng.next(), rng.next()), d, pdf);
+    if (pdf > 0.0f && d.y > 0.0f) {
+      referans += l.y * d.y / pdf;
+    }
+  }
+  referans /= REF;
+  std::cout << "isinim: " << referans << " (" << ORNEK << " ornekli "
+            << DENEME << " tahmin)" << std::endl;
+  hataYaz("kosinus", ortam, float(referans), kosinusTahmini);
+  hataYaz("harita ", ortam, float(referans), haritaTahmini);
+
+  // ornek basina maliyet
+  const int SURE = 1 << 22;
+  float toplam = 0.0f;
+  bas = std::chrono::steady_clock::now();
+  for (int i = 0; i < SURE; i++) {
+    glm::vec3 d;
+    float pdf;
+    toplam += ortam.sample(glm::vec2(rng.next(), rng.next()), d, pdf).x + pdf;
+  }
+  double sure = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - bas)
+                    .count();
+  std::cout << "ornek basina: " << sure * 1.0e9 / SURE << " ns (" << toplam
+            << ")" << std::endl;
+  return 0;
+}
@@ -1,26 +1,87 @@
 // ppm ciktisi
+#include <custom/aov.hpp>
+#include <custom/camera.hpp>
+#include <custom/denoiser.hpp>
+#include <custom/framebuffer.hpp>
+#include <custom/integrator.hpp>
+#include <custom/sampler.hpp>
+#include <custom/scene.hpp>
+#include <custom/texture.hpp>
+
 #include <iostream>
+#include <memory>
+#include <vector>
 
 int main(void) {
   //
   const int resim_en = 256;
   const int resim_boy = 256;
-  std::cout << "P3\n" << resim_en << ' ' << resim_boy << "\n255\n";
-
-  // tersten yaziyoruz
-  for (int j = resim_boy - 1; j >= 0; --j) {
-    for (int i = 0; i < resim_en; ++i) {
-      double r = double(j) / (resim_en - 1);
-      double g = double(j) / (resim_boy - 1);
-      double b = 0.26;
 
-      int ir = static_cast<int>(255.9 * r);
-      int ig = static_cast<int>(255.9 * g);
-      int ib = static_cast<int>(255.9 * b);
+  // kamera orijinde -z ye bakiyor, 90 derece gorus acisi
+  const Camera kamera(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), YAW,
+                      PITCH, 90.0f);
+  const float en_boy = float(resim_en) / resim_boy;
 
-      std::cout << ir << ' ' << ig << ' ' << ib << '\n';
+  // zemin icin dama dokusu, uzakta kareler pikselden kucuk kaliyor ve
+  // isin farklari dogru mip seviyesini seciyor
+  const int doku_boyu = 1024;
+  std::vector<unsigned char> dama(doku_boyu * doku_boyu * 3);
+  for (int y = 0; y < doku_boyu; y++) {
+    for (int x = 0; x < doku_boyu; x++) {
+      unsigned char c = ((x / 4) + (y / 4)) % 2 == 0 ? 255 : 64;
+      unsigned char *p = &dama[(y * doku_boyu + x) * 3];
+      p[0] = p[1] = p[2] = c;
     }
   }
-  std::cout << std::endl;
+  auto doku = std::make_shared<CpuTexture>();
+  doku->build(dama.data(), doku_boyu, doku_boyu, 3);
+
+  // sahne
+  Scene sahne;
+  int dama_id = sahne.addTexture(SceneTexture(doku));
+  int kirmizi = sahne.addMaterial(glm::vec3(0.7f, 0.3f, 0.3f));
+  int zemin = sahne.addMaterial(glm::vec3(0.8f, 0.8f, 0.0f), dama_id);
+  sahne.addSphere(glm::vec3(0.0f, 0.0f, -1.0f), 0.5f, kirmizi);
+  sahne.addSphere(glm::vec3(0.0f, -100.5f, -1.0f), 100.0f, zemin);
+  sahne.directionalLights.push_back(DirectionalLight(
+      glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(2.0f), glm::vec3(1.0f)));
+
+  // duz bolgeler birkac ornekten sonra birakilir
+  AdaptiveSettings ayar;
+  ayar.maxSamples = 256;
+  ayar.timeBudget = 10.0;
+
+  // sahnede ne varsa ona gore ozellesmis integrator bir kere seciliyor
+  const unsigned int kanallar = AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO;
+  dispatchIntegrator<kanallar>(sahne, [&](const auto &integrator) {
+    // temizleyici icin derinlik, normal ve albedo da tutuluyor
+    AovFramebuffer<kanallar> cerceve(resim_en, resim_boy);
+
+    AdaptiveStats istatistik = renderAdaptive(
+        cerceve,
+        [&](int i, int j, Rng &rng) {
+          // piksel icinde rastgele bir nokta
+          float u = (i + rng.next()) / resim_en;
+          float v = (j + rng.next()) / resim_boy;
+          return integrator.sample(
+              kamera.getRayDifferential(u, v, en_boy, 1.0f / resim_en,
+                                        1.0f / resim_boy),
+              rng);
+        },
+        ayar);
+
+    std::cerr << "gecis: " << istatistik.passes
+              << " ornek: " << istatistik.sampleCount
+              << " ortalama hata: " << istatistik.meanError
+              << " sure: " << istatistik.seconds << "s" << std::endl;
+
+    // az ornekli goruntuyu temizle
+    AtrousDenoiser temizleyici;
+    DenoiseStats temizlik = temizleyici.denoise(cerceve, cerceve.getGuides());
+    std::cerr << "temizleme: " << temizlik.seconds << "s ("
+              << temizlik.msPerMegapixel << " ms/MP)" << std::endl;
+
+    writePpm(std::cout, cerceve);
+  });
   return 0; //
 }
@@ -0,0 +1,155 @@
+// sikistirilmis geometri: bellek ve cozme maliyeti
+#include <custom/compactgeometry.hpp>
+#include <custom/geometry.hpp>
+#include <custom/sampler.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+const unsigned int AG_SAYISI = 16;
+const unsigned int AG_BOYU = 256;
+const unsigned int SORGU = 1 << 22;
+
+// her biri ayri bir kure olan AG_SAYISI ag, yarisi normal haritali
+SceneGeometry geometriKur() {
+  SceneGeometry g;
+  g.materials.resize(2);
+  g.materials[1].normalPath = "normal.png";
+  unsigned int tepe = AG_BOYU * AG_BOYU;
+  unsigned int ucgen = 2 * (AG_BOYU - 1) * (AG_BOYU - 1);
+  for (unsigned int m = 0; m < AG_SAYISI; m++) {
+    GeometryMesh ag;
+    ag.firstVertex = m * tepe;
+    ag.vertexCount = tepe;
+    ag.firstIndex = m * 3 * ucgen;
+    ag.indexCount = 3 * ucgen;
+    ag.materialId = static_cast<int>(m % 2);
+    if (ag.materialId == 1) {
+      ag.firstTangent = static_cast<unsigned int>(g.tangents.size());
+    }
+    glm::vec3 merkez(float(m % 4) * 3.0f, float(m / 4) * 3.0f, -10.0f);
+    for (unsigned int j = 0; j < AG_BOYU; j++) {
+      for (unsigned int i = 0; i < AG_BOYU; i++) {
+        float u = float(i) / float(AG_BOYU - 1);
+        float v = float(j) / float(AG_BOYU - 1);
+        float phi = u * glm::two_pi<float>();
+        float theta = v * glm::pi<float>();
+        glm::vec3 n(std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi));
+        g.positions.push_back(merkez + n);
+        g.normals.push_back(n);
+        g.uvs.push_back(glm::vec2(u, v));
+        if (ag.hasTangents()) {
+          glm::vec3 t(-std::sin(phi), 0.0f, std::cos(phi));
+          g.tangents.push_back(t);
+          g.bitangents.push_back(glm::cross(n, t));
+        }
+      }
+    }
+    for (unsigned int j = 0; j + 1 < AG_BOYU; j++) {
+      for (unsigned int i = 0; i + 1 < AG_BOYU; i++) {
+        unsigned int k = ag.firstVertex + j * AG_BOYU + i;
+        unsigned int dortgen[6] = {k,     k + AG_BOYU, k + 1,
+                                   k + 1, k + AG_BOYU, k + AG_BOYU + 1};
+        g.indices.insert(g.indices.end(), dortgen, dortgen + 6);
+        g.triangleMaterials.push_back(ag.materialId);
+        g.triangleMaterials.push_back(ag.materialId);
+      }
+    }
+    g.meshes.push_back(ag);
+  }
+  return g;
+}
+
+// golgelendirme gibi: rastgele ucgen, konum, normal ve uv ara degeri
+template <typename Geometry, typename Fetch>
+double sorgula(const Geometry &g, Fetch getir, float &toplam) {
+  Rng rng(12345u);
+  auto bas = std::chrono::steady_clock::now();
+  for (unsigned int s = 0; s < SORGU; s++) {
+    std::size_t t = rng.nextUint() % g.getTriangleCount();
+    float b1 = rng.next();
+    float b2 = rng.next() * (1.0f - b1);
+    glm::vec3 p, n;
+    glm::vec2 uv;
+    getir(t, 1.0f - b1 - b2, b1, b2, p, n, uv);
+    toplam += p.x + n.y + uv.x;
+  }
+  std::chrono::duration<double> sure = std::chrono::steady_clock::now() - bas;
+  return sure.count();
+}
+
+int main(void) {
+  SceneGeometry g = geometriKur();
+
+  auto bas = std::chrono::steady_clock::now();
+  CompactGeometry c(g);
+  std::chrono::duration<double> kodlama =
+      std::chrono::steady_clock::now() - bas;
+
+  // en buyuk hatalar
+  float konumHata = 0.0f;
+  float normalHata = 0.0f;
+  float uvHata = 0.0f;
+  for (std::size_t m = 0; m < g.meshes.size(); m++) {
+    const GeometryMesh &ag = g.meshes[m];
+    for (unsigned int i = 0; i < ag.vertexCount; i++) {
+      unsigned int v = ag.firstVertex + i;
+      konumHata = std::max(
+          konumHata, glm::length(c.getPosition(m, v) - g.positions[v]));
+      float cosHata = glm::clamp(glm::dot(c.getNormal(v), g.normals[v]),
+                                 -1.0f, 1.0f);
+      normalHata = std::max(normalHata, std::acos(cosHata));
+      glm::vec2 d = glm::abs(c.getUv(v) - g.uvs[v]);
+      uvHata = std::max(uvHata, std::max(d.x, d.y));
+    }
+  }
+
+  float toplam = 0.0f;
+  double hamSure = sorgula(
+      g,
+      [&](std::size_t t, float w0, float w1, float w2, glm::vec3 &p,
+          glm::vec3 &n, glm::vec2 &uv) {
+        const unsigned int *k = &g.indices[3 * t];
+        p = w0 * g.positions[k[0]] + w1 * g.positions[k[1]] +
+            w2 * g.positions[k[2]];
+        n = glm::normalize(w0 * g.normals[k[0]] + w1 * g.normals[k[1]] +
+                           w2 * g.normals[k[2]]);
+        uv = w0 * g.uvs[k[0]] + w1 * g.uvs[k[1]] + w2 * g.uvs[k[2]];
+      },
+      toplam);
+  double sikiSure = sorgula(
+      c,
+      [&](std::size_t t, float w0, float w1, float w2, glm::vec3 &p,
+          glm::vec3 &n, glm::vec2 &uv) {
+        std::size_t m = c.findMesh(t);
+        const unsigned int *k = &c.indices[3 * t];
+        p = w0 * c.getPosition(m, k[0]) + w1 * c.getPosition(m, k[1]) +
+            w2 * c.getPosition(m, k[2]);
+        n = glm::normalize(w0 * c.getNormal(k[0]) + w1 * c.getNormal(k[1]) +
+                           w2 * c.getNormal(k[2]));
+        uv = w0 * c.getUv(k[0]) + w1 * c.getUv(k[1]) + w2 * c.getUv(k[2]);
+      },
+      toplam);
+
+  double mb = 1024.0 * 1024.0;
+  std::cout << "tepe: " << g.getVertexCount()
+            << " ucgen: " << g.getTriangleCount() << std::endl;
+  std::cout << "bellek: " << g.getMemorySize() / mb << " MB -> "
+            << c.getMemorySize() / mb << " MB ("
+            << 100.0 * c.getMemorySize() / g.getMemorySize() << "%)"
+            << std::endl;
+  std::cout << "kodlama: " << kodlama.count() << "s" << std::endl;
+  std::cout << "ham: " << SORGU / hamSure / 1.0e6 << " Msorgu/s, "
+            << "sikistirilmis: " << SORGU / sikiSure / 1.0e6 << " Msorgu/s ("
+            << sikiSure / hamSure << "x sure)" << std::endl;
+  std::cout << "en buyuk hata: konum " << konumHata << ", normal "
+            << glm::degrees(normalHata) << " derece, uv " << uvHata
+            << std::endl;
+  // derleyici sorgulari silmesin
+  std::cerr << "toplam: " << toplam << std::endl;
+  return 0;
+}
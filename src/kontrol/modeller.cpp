@@ -0,0 +1,93 @@
+// gl olmadan model kodu: teget cercevesi ve cpu model yuklemesi
+// assimp kurulu degilse src/kontrol/stub altindaki alt kume ile derlenir
+#include <custom/cpumodel.hpp>
+#include <custom/tangents.hpp>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// iki ucgenli kare, assimp gibi her yuz kendi koselerini tasiyor
+const unsigned int KOSE = 6;
+
+bool yakin(glm::vec3 a, glm::vec3 b) {
+  return glm::length(a - b) < 1.0e-5f;
+}
+
+int tegetleriDene() {
+  aiVector3D konum[KOSE] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0},
+                            {0, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  aiVector3D normal[KOSE];
+  aiVector3D uv[KOSE];
+  for (unsigned int i = 0; i < KOSE; i++) {
+    normal[i] = aiVector3D(0, 0, 1);
+    uv[i] = aiVector3D(konum[i].x, konum[i].y, 0);
+  }
+  unsigned int sira[KOSE] = {0, 1, 2, 3, 4, 5};
+  aiFace yuz[2];
+  for (unsigned int f = 0; f < 2; f++) {
+    yuz[f].mNumIndices = 3;
+    yuz[f].mIndices = &sira[3 * f];
+  }
+  aiMesh ag;
+  ag.mNumVertices = KOSE;
+  ag.mNumFaces = 2;
+  ag.mVertices = konum;
+  ag.mNormals = normal;
+  ag.mTextureCoords[0] = uv;
+  ag.mFaces = yuz;
+
+  glm::vec3 teget[KOSE], yanTeget[KOSE];
+  if (!computeTangentFrames(&ag, teget, yanTeget)) {
+    std::cerr << "teget cercevesi hesaplanmadi" << std::endl;
+    return 1;
+  }
+  // uv ekseni konum ekseniyle ayni: teget x, yan teget y olmali
+  int hata = 0;
+  for (unsigned int i = 0; i < KOSE; i++) {
+    if (!yakin(teget[i], glm::vec3(1, 0, 0)) ||
+        !yakin(yanTeget[i], glm::vec3(0, 1, 0))) {
+      hata++;
+    }
+  }
+  // uv olmadan cerceve yok
+  ag.mTextureCoords[0] = nullptr;
+  if (computeTangentFrames(&ag, teget, yanTeget)) {
+    hata++;
+  }
+  std::cout << "teget cercevesi: " << (hata == 0 ? "dogru" : "yanlis")
+            << std::endl;
+  return hata == 0 ? 0 : 1;
+}
+
+int modeliDene() {
+  std::filesystem::path yol =
+      std::filesystem::temp_directory_path() / "modelkontrol.obj";
+  {
+    std::ofstream obj(yol);
+    obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        << "vn 0 0 1\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        << "f 1/1/1 2/2/1 3/3/1 4/4/1\n";
+  }
+  CpuModel model(yol.c_str(), false);
+  std::filesystem::remove(yol);
+  GeometryView g = model.getGeometry();
+#if defined(ASSIMP_STUB)
+  // saplama hicbir dosya okumaz, yalnizca bos kalmasi beklenir
+  std::cout << "cpu model: assimp yok, yalnizca derlendi" << std::endl;
+  return g.meshCount == 0 ? 0 : 1;
+#else
+  // dortgen iki ucgene bolunur, kaynasan koseler dort kalir
+  std::cout << "cpu model: " << g.meshCount << " ag, " << g.indexCount / 3
+            << " ucgen, " << g.vertexCount << " kose" << std::endl;
+  return g.meshCount == 1 && g.indexCount == 6 && g.vertexCount == 4 ? 0 : 1;
+#endif
+}
+
+int main(void) {
+  int hata = tegetleriDene();
+  hata += modeliDene();
+  return hata;
+}
@@ -0,0 +1,27 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef STUB_ASSIMP_IMPORTER_HPP
+#define STUB_ASSIMP_IMPORTER_HPP
+
+#include <assimp/scene.h>
+
+#include <string>
+
+namespace Assimp {
+
+// reads nothing, a model load through it ends in its error string
+class Importer {
+public:
+  const aiScene *ReadFile(const std::string &, unsigned int) {
+    return nullptr;
+  }
+  const char *GetErrorString() const {
+    return "assimp stub, model files can not be read";
+  }
+};
+
+} // namespace Assimp
+
+#endif
@@ -0,0 +1,42 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef STUB_ASSIMP_MATERIAL_H
+#define STUB_ASSIMP_MATERIAL_H
+
+#include <assimp/mesh.h>
+
+#include <string>
+
+enum aiReturn { aiReturn_SUCCESS = 0, aiReturn_FAILURE = -1 };
+
+enum aiTextureType {
+  aiTextureType_NONE = 0,
+  aiTextureType_DIFFUSE = 1,
+  aiTextureType_SPECULAR = 2,
+  aiTextureType_AMBIENT = 3,
+  aiTextureType_HEIGHT = 5
+};
+
+// key, type and index, as assimp spells it
+#define AI_MATKEY_COLOR_DIFFUSE "$clr.diffuse", 0, 0
+
+struct aiString {
+  std::string data;
+
+  const char *C_Str() const { return this->data.c_str(); }
+};
+
+// a stub material has no textures and no properties
+struct aiMaterial {
+  unsigned int GetTextureCount(aiTextureType) const { return 0; }
+  aiReturn GetTexture(aiTextureType, unsigned int, aiString *) const {
+    return aiReturn_FAILURE;
+  }
+  aiReturn Get(const char *, unsigned int, unsigned int, aiColor4D &) const {
+    return aiReturn_FAILURE;
+  }
+};
+
+#endif
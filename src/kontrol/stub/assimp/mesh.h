@@ -0,0 +1,49 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef STUB_ASSIMP_MESH_H
+#define STUB_ASSIMP_MESH_H
+
+/* The part of the assimp scene types the gl free model code reads, with
+   the same names and layout of members, so cpumodel.hpp and tangents.hpp
+   compile on machines without assimp. Used by src/kontrol only.
+ */
+#define ASSIMP_STUB 1
+
+struct aiVector3D {
+  float x = 0.0f, y = 0.0f, z = 0.0f;
+
+  aiVector3D() {}
+  aiVector3D(float x, float y, float z) : x(x), y(y), z(z) {}
+  bool operator==(const aiVector3D &o) const {
+    return this->x == o.x && this->y == o.y && this->z == o.z;
+  }
+};
+
+inline aiVector3D operator-(const aiVector3D &a, const aiVector3D &b) {
+  return aiVector3D(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+struct aiColor4D {
+  float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+};
+
+struct aiFace {
+  unsigned int mNumIndices = 0;
+  unsigned int *mIndices = nullptr;
+};
+
+const unsigned int AI_MAX_NUMBER_OF_TEXTURECOORDS = 8;
+
+struct aiMesh {
+  unsigned int mNumVertices = 0;
+  unsigned int mNumFaces = 0;
+  aiVector3D *mVertices = nullptr;
+  aiVector3D *mNormals = nullptr;
+  aiVector3D *mTextureCoords[AI_MAX_NUMBER_OF_TEXTURECOORDS] = {};
+  aiFace *mFaces = nullptr;
+  unsigned int mMaterialIndex = 0;
+};
+
+#endif
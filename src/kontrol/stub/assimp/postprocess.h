@@ -0,0 +1,14 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef STUB_ASSIMP_POSTPROCESS_H
+#define STUB_ASSIMP_POSTPROCESS_H
+
+enum aiPostProcessSteps {
+  aiProcess_CalcTangentSpace = 0x1,
+  aiProcess_Triangulate = 0x8,
+  aiProcess_FlipUVs = 0x800000
+};
+
+#endif
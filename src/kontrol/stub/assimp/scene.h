@@ -0,0 +1,29 @@
+// author: Kaan Eraslan
+
+// includes
+
+#ifndef STUB_ASSIMP_SCENE_H
+#define STUB_ASSIMP_SCENE_H
+
+#include <assimp/material.h>
+#include <assimp/mesh.h>
+
+const unsigned int AI_SCENE_FLAGS_INCOMPLETE = 0x1;
+
+struct aiNode {
+  unsigned int mNumMeshes = 0;
+  unsigned int *mMeshes = nullptr;
+  unsigned int mNumChildren = 0;
+  aiNode **mChildren = nullptr;
+};
+
+struct aiScene {
+  unsigned int mFlags = 0;
+  aiNode *mRootNode = nullptr;
+  unsigned int mNumMeshes = 0;
+  aiMesh **mMeshes = nullptr;
+  unsigned int mNumMaterials = 0;
+  aiMaterial **mMaterials = nullptr;
+};
+
+#endif